@@ -1,9 +1,19 @@
 #include "Shader.hpp"
 
+#include <GLES3/gl31.h>
 #include <fmt/core.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 
+#include "gl_state.hpp"
+#include "trace.hpp"
+
 static inline std::string_view parentOf(const std::string_view & path) {
     auto lastSlash = path.find_last_of('/');
     if (lastSlash == std::string_view::npos)
@@ -15,7 +25,7 @@ static std::string shaderSource(const std::string_view & path,
                                 std::vector<std::string> & loaded) {
     for (auto & l : loaded) {
         if (l == path) {
-            fmt::print("File already included {}, skipping\n", path);
+            fmt::print(stderr, "File already included {}, skipping\n", path);
             return "";
         }
     }
@@ -24,7 +34,7 @@ static std::string shaderSource(const std::string_view & path,
 
     std::ifstream is(path.data());
     if (!is) {
-        fmt::print("shaderSource path={} failed to open file\n", path);
+        fmt::print(stderr, "shaderSource path={} failed to open file\n", path);
         return std::string();
     }
 
@@ -86,24 +96,168 @@ static std::string linkError(GLuint program) {
 
 static GLuint compileShader(GLuint shaderType,
                             const std::string_view & shaderSource) {
+    TRACE_SCOPE("compile");
     GLuint shader = glCreateShader(shaderType);
     const char * source = shaderSource.data();
-    glShaderSource(shader, 1, &source, NULL);
+    GLint length = shaderSource.size();
+    glShaderSource(shader, 1, &source, &length);
     glCompileShader(shader);
     return shader;
 }
 
+static bool linkProgram(GLuint program) {
+    TRACE_SCOPE("link");
+    glLinkProgram(program);
+    return linkSuccess(program);
+}
+
+static std::string defaultBinaryCacheDir() {
+    if (auto dir = std::getenv("EGL_MATH_SHADER_CACHE"))
+        return dir;
+    if (auto dir = std::getenv("XDG_CACHE_HOME"))
+        return std::string(dir) + "/egl-math";
+    if (auto dir = std::getenv("HOME"))
+        return std::string(dir) + "/.cache/egl-math";
+    return std::string();
+}
+
+static std::string & binaryCacheDir() {
+    static std::string dir = defaultBinaryCacheDir();
+    return dir;
+}
+
+// Written at the start of each cache file, followed by the binary format
+static const uint32_t binaryMagic = 0x45474C42; // EGLB
+
+static uint64_t fnv1a(uint64_t hash, const std::string_view & data) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static std::string_view glString(GLenum name) {
+    auto str = reinterpret_cast<const char *>(glGetString(name));
+    return str ? str : "";
+}
+
+/**
+ * Get the cache file for a program, keyed by the sources, the transform
+ * feedback varyings and the driver strings so a driver update never loads a
+ * stale binary.
+ *
+ * @return the path or an empty string if the cache is disabled or the driver
+ *         does not support program binaries
+ */
+static std::string binaryCachePath(const std::string_view & vertexSource,
+                                   const std::string_view & fragmentSource,
+                                   const std::vector<std::string> & varyings = {}) {
+    auto & dir = binaryCacheDir();
+    if (dir.empty())
+        return std::string();
+
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if (numFormats <= 0)
+        return std::string();
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto part : {vertexSource, fragmentSource, glString(GL_VENDOR),
+                      glString(GL_RENDERER), glString(GL_VERSION)}) {
+        hash = fnv1a(hash, part);
+        // Separate parts so moving text between them changes the hash
+        hash = fnv1a(hash, std::string_view("\0", 1));
+    }
+    for (auto & varying : varyings) {
+        hash = fnv1a(hash, varying);
+        hash = fnv1a(hash, std::string_view("\0", 1));
+    }
+
+    return fmt::format("{}/{:016x}.bin", dir, hash);
+}
+
+static bool loadBinary(GLuint program, const std::string & path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is)
+        return false;
+
+    uint32_t magic = 0;
+    GLenum format = 0;
+    is.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+    is.read(reinterpret_cast<char *>(&format), sizeof(format));
+    if (!is || magic != binaryMagic)
+        return false;
+
+    std::vector<char> binary((std::istreambuf_iterator<char>(is)),
+                             std::istreambuf_iterator<char>());
+    if (binary.empty())
+        return false;
+
+    glProgramBinary(program, format, binary.data(), binary.size());
+
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success != GL_FALSE;
+}
+
+static void saveBinary(GLuint program, const std::string & path) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    // Write to a temporary file and rename so concurrent runs never read a
+    // partial binary, the counter keeps worker threads of one run apart
+    static std::atomic<unsigned> tmpCount {0};
+    auto tmpPath = fmt::format("{}.{}.{}.tmp", path, getpid(), tmpCount++);
+    {
+        std::ofstream os(tmpPath, std::ios::binary);
+        os.write(reinterpret_cast<const char *>(&binaryMagic), sizeof(binaryMagic));
+        os.write(reinterpret_cast<const char *>(&format), sizeof(format));
+        os.write(binary.data(), length);
+        if (!os) {
+            fmt::print(stderr, "failed to write shader binary cache {}\n", tmpPath);
+            std::filesystem::remove(tmpPath, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec)
+        std::filesystem::remove(tmpPath, ec);
+}
+
 Shader::Shader() : program(glCreateProgram()) {}
 
 Shader::~Shader() {
-    glDeleteProgram(program);
+    GLState::deleteProgram(program);
 }
 
 bool Shader::loadFromSource(const std::string_view & vertexSource,
                             const std::string_view & fragmentSource) {
+    return loadFromSource(vertexSource, fragmentSource, {});
+}
+
+bool Shader::loadFromSource(const std::string_view & vertexSource,
+                            const std::string_view & fragmentSource,
+                            const std::vector<std::string> & varyings) {
+    TRACE_SCOPE("shader");
+    auto cachePath = binaryCachePath(vertexSource, fragmentSource, varyings);
+    if (!cachePath.empty() && loadBinary(program, cachePath)) {
+        loadUniforms();
+        return true;
+    }
+
     GLuint vShader = compileShader(GL_VERTEX_SHADER, vertexSource);
     if (!compileSuccess(vShader)) {
-        fmt::print("failed to compile vertex shader {}: {}\n", vShader,
+        fmt::print(stderr, "failed to compile vertex shader {}: {}\n", vShader,
                    compileError(vShader));
         glDeleteShader(vShader);
         return false;
@@ -111,7 +265,7 @@ bool Shader::loadFromSource(const std::string_view & vertexSource,
 
     GLuint fShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
     if (!compileSuccess(fShader)) {
-        fmt::print("failed to compile fragment shader {}: {}\n", fShader,
+        fmt::print(stderr, "failed to compile fragment shader {}: {}\n", fShader,
                    compileError(fShader));
         glDeleteShader(vShader);
         glDeleteShader(fShader);
@@ -121,22 +275,87 @@ bool Shader::loadFromSource(const std::string_view & vertexSource,
     glAttachShader(program, vShader);
     glAttachShader(program, fShader);
 
-    glLinkProgram(program);
+    if (!varyings.empty()) {
+        std::vector<const char *> names;
+        for (auto & varying : varyings) {
+            names.push_back(varying.c_str());
+        }
+        glTransformFeedbackVaryings(program, names.size(), names.data(),
+                                    GL_INTERLEAVED_ATTRIBS);
+    }
+
+    if (!cachePath.empty())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    bool linked = linkProgram(program);
 
     glDetachShader(program, vShader);
     glDetachShader(program, fShader);
     glDeleteShader(vShader);
     glDeleteShader(fShader);
 
-    if (!linkSuccess(program)) {
-        fmt::print("failed to link shader program {}: {}\n", program,
+    if (!linked) {
+        fmt::print(stderr, "failed to link shader program {}: {}\n", program,
                    linkError(program));
         return false;
     }
 
+    if (!cachePath.empty())
+        saveBinary(program, cachePath);
+
+    loadUniforms();
+
     return true;
 }
 
+bool Shader::loadFromComputeSource(const std::string_view & computeSource) {
+    TRACE_SCOPE("shader");
+    // No vertex source keeps the key apart from the fragment programs
+    auto cachePath = binaryCachePath("", computeSource);
+    if (!cachePath.empty() && loadBinary(program, cachePath)) {
+        loadUniforms();
+        return true;
+    }
+
+    GLuint cShader = compileShader(GL_COMPUTE_SHADER, computeSource);
+    if (!compileSuccess(cShader)) {
+        fmt::print(stderr, "failed to compile compute shader {}: {}\n", cShader,
+                   compileError(cShader));
+        glDeleteShader(cShader);
+        return false;
+    }
+
+    glAttachShader(program, cShader);
+
+    if (!cachePath.empty())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    bool linked = linkProgram(program);
+
+    glDetachShader(program, cShader);
+    glDeleteShader(cShader);
+
+    if (!linked) {
+        fmt::print(stderr, "failed to link compute program {}: {}\n", program, linkError(program));
+        return false;
+    }
+
+    if (!cachePath.empty())
+        saveBinary(program, cachePath);
+
+    loadUniforms();
+
+    return true;
+}
+
+void Shader::setBinaryCacheDir(const std::string_view & dir) {
+    binaryCacheDir() = dir;
+}
+
+const std::string & Shader::getBinaryCacheDir() {
+    return binaryCacheDir();
+}
+
 bool Shader::loadFromPath(const std::string_view & vertexPath,
                           const std::string_view & fragmentPath) {
 
@@ -144,13 +363,13 @@ bool Shader::loadFromPath(const std::string_view & vertexPath,
     std::string fragmentSource = shaderSource(fragmentPath);
 
     if (vertexSource.empty()) {
-        fmt::print("vertex shader source could not be loaded from path {}\n",
+        fmt::print(stderr, "vertex shader source could not be loaded from path {}\n",
                    vertexPath);
         return false;
     }
 
     if (fragmentSource.empty()) {
-        fmt::print("fragment shader source could not be loaded from path {}\n",
+        fmt::print(stderr, "fragment shader source could not be loaded from path {}\n",
                    fragmentPath);
         return false;
     }
@@ -163,22 +382,54 @@ GLuint Shader::getProgram() const {
 }
 
 void Shader::bind() const {
-    glUseProgram(program);
+    GLState::useProgram(program);
 }
 
 void Shader::unbind() const {
-    glUseProgram(0);
+    GLState::useProgram(0);
+}
+
+GLint Shader::uniformLocation(const std::string_view & name) const {
+    auto it = uniforms.find(name);
+    if (it == uniforms.end())
+        return -1;
+    return it->second;
 }
 
-GLuint Shader::uniformLocation(const std::string_view & name) const {
-    return glGetUniformLocation(program, name.data());
+void Shader::loadUniforms() {
+    uniforms.clear();
+
+    GLint count = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+
+    GLint maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<GLchar> nameBuff(std::max(maxLength, 1));
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, i, nameBuff.size(), &length, &size, &type,
+                           nameBuff.data());
+
+        std::string name(nameBuff.data(), length);
+        GLint location = glGetUniformLocation(program, name.c_str());
+        if (location < 0)
+            continue;
+
+        // Arrays are reported as name[0], also allow just name
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            uniforms.emplace(name.substr(0, name.size() - 3), location);
+        uniforms.emplace(std::move(name), location);
+    }
 }
 
 void Shader::setBool(const std::string_view & name, bool value) const {
     setBool(uniformLocation(name), value);
 }
 
-void Shader::setBool(GLuint location, bool value) const {
+void Shader::setBool(GLint location, bool value) const {
     glUniform1i(location, static_cast<int>(value));
 }
 
@@ -186,7 +437,7 @@ void Shader::setInt(const std::string_view & name, int value) const {
     setInt(uniformLocation(name), value);
 }
 
-void Shader::setInt(GLuint location, int value) const {
+void Shader::setInt(GLint location, int value) const {
     glUniform1i(location, value);
 }
 
@@ -194,7 +445,7 @@ void Shader::setFloat(const std::string_view & name, float value) const {
     setFloat(uniformLocation(name), value);
 }
 
-void Shader::setFloat(GLuint location, float value) const {
+void Shader::setFloat(GLint location, float value) const {
     glUniform1f(location, value);
 }
 
@@ -202,7 +453,7 @@ void Shader::setVec2(const std::string_view & name, const glm::vec2 & value) con
     setVec2(uniformLocation(name), value);
 }
 
-void Shader::setVec2(GLuint location, const glm::vec2 & value) const {
+void Shader::setVec2(GLint location, const glm::vec2 & value) const {
     glUniform2fv(location, 1, &value.x);
 }
 
@@ -210,7 +461,7 @@ void Shader::setVec3(const std::string_view & name, const glm::vec3 & value) con
     setVec3(uniformLocation(name), value);
 }
 
-void Shader::setVec3(GLuint location, const glm::vec3 & value) const {
+void Shader::setVec3(GLint location, const glm::vec3 & value) const {
     glUniform3fv(location, 1, &value.x);
 }
 
@@ -218,7 +469,7 @@ void Shader::setVec4(const std::string_view & name, const glm::vec4 & value) con
     setVec4(uniformLocation(name), value);
 }
 
-void Shader::setVec4(GLuint location, const glm::vec4 & value) const {
+void Shader::setVec4(GLint location, const glm::vec4 & value) const {
     glUniform4fv(location, 1, &value.x);
 }
 
@@ -226,7 +477,7 @@ void Shader::setMat2(const std::string_view & name, const glm::mat2 & value) con
     setMat2(uniformLocation(name), value);
 }
 
-void Shader::setMat2(GLuint location, const glm::mat2 & value) const {
+void Shader::setMat2(GLint location, const glm::mat2 & value) const {
     glUniformMatrix2fv(location, 1, GL_FALSE, &value[0][0]);
 }
 
@@ -234,7 +485,7 @@ void Shader::setMat3(const std::string_view & name, const glm::mat3 & value) con
     setMat3(uniformLocation(name), value);
 }
 
-void Shader::setMat3(GLuint location, const glm::mat3 & value) const {
+void Shader::setMat3(GLint location, const glm::mat3 & value) const {
     glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]);
 }
 
@@ -242,7 +493,7 @@ void Shader::setMat4(const std::string_view & name, const glm::mat4 & value) con
     setMat4(uniformLocation(name), value);
 }
 
-void Shader::setMat4(GLuint location, const glm::mat4 & value) const {
+void Shader::setMat4(GLint location, const glm::mat4 & value) const {
     glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
 }
 
@@ -261,6 +512,13 @@ void main() {
     FragTex = aTex;
 })";
 
+// Nothing is rasterized when capturing, but a program needs a fragment
+// shader on GLES
+static const std ::string emptyFragmentShaderSource = R"(
+#version 330 core
+void main() {
+})";
+
 static const std ::string defaultFragmentShaderSource = R"(
 #version 330 core
 out vec4 FragColor;
@@ -277,7 +535,7 @@ Shader::Ptr Shader::defaultShader() {
     if (shader
         && !shader->loadFromSource(defaultVertexShaderSource,
                                    defaultFragmentShaderSource)) {
-        fmt::print("Failed to compile the default shader\n");
+        fmt::print(stderr, "Failed to compile the default shader\n");
         return nullptr;
     }
     return shader;
@@ -288,11 +546,41 @@ Shader::Ptr Shader::fromFragmentPath(const std::string_view & path) {
     return fromFragmentSource(source);
 }
 
+Shader::Ptr Shader::fromFragmentPath(const std::string_view & path,
+                                     const std::string_view & header) {
+    auto source = shaderSource(path);
+    if (source.empty()) {
+        fmt::print(stderr, "fragment shader source could not be loaded from path {}\n",
+                   path);
+        return nullptr;
+    }
+    return fromFragmentSource(std::string(header) + source);
+}
+
 Shader::Ptr Shader::fromFragmentSource(const std::string_view & fragmentSource) {
     auto shader = std::make_shared<Shader>();
     if (shader
         && !shader->loadFromSource(defaultVertexShaderSource, fragmentSource)) {
-        fmt::print("Failed to compile the fragment shader from source\n");
+        fmt::print(stderr, "Failed to compile the fragment shader from source\n");
+        return nullptr;
+    }
+    return shader;
+}
+
+Shader::Ptr Shader::fromComputeSource(const std::string_view & source) {
+    auto shader = std::make_shared<Shader>();
+    if (shader && !shader->loadFromComputeSource(source)) {
+        fmt::print(stderr, "Failed to compile the compute shader from source\n");
+        return nullptr;
+    }
+    return shader;
+}
+
+Shader::Ptr Shader::fromFeedbackSource(const std::string_view & source,
+                                       const std::vector<std::string> & varyings) {
+    auto shader = std::make_shared<Shader>();
+    if (shader && !shader->loadFromSource(source, emptyFragmentShaderSource, varyings)) {
+        fmt::print(stderr, "Failed to compile the transform feedback shader from source\n");
         return nullptr;
     }
     return shader;
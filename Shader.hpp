@@ -1,21 +1,86 @@
 #pragma once
 
-#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
 
+#include <functional>
 #include <glm/glm.hpp>
+#include <map>
 #include <memory>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
 // https://www.khronos.org/opengl/wiki/Shader_Compilation
 
+/**
+ * A uniform location resolved once, used to set a uniform of type T without
+ * looking up its name. The shader must be bound when calling set.
+ */
+template <typename T>
+class Uniform {
+    GLint location;
+
+public:
+    /**
+     * Create a new Uniform, -1 is an inactive uniform which ignores set.
+     *
+     * @param location the uniform location
+     */
+    explicit Uniform(GLint location = -1) : location(location) {}
+
+    GLint getLocation() const {
+        return location;
+    }
+
+    /**
+     * Is this an active uniform in the shader.
+     */
+    bool isValid() const {
+        return location >= 0;
+    }
+
+    /**
+     * Set the value.
+     *
+     * @param value the value to set
+     */
+    void set(const T & value) const {
+        if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, int>)
+            glUniform1i(location, static_cast<int>(value));
+        else if constexpr (std::is_same_v<T, unsigned>)
+            glUniform1ui(location, value);
+        else if constexpr (std::is_same_v<T, float>)
+            glUniform1f(location, value);
+        else if constexpr (std::is_same_v<T, glm::ivec2>)
+            glUniform2iv(location, 1, &value.x);
+        else if constexpr (std::is_same_v<T, glm::vec2>)
+            glUniform2fv(location, 1, &value.x);
+        else if constexpr (std::is_same_v<T, glm::vec3>)
+            glUniform3fv(location, 1, &value.x);
+        else if constexpr (std::is_same_v<T, glm::vec4>)
+            glUniform4fv(location, 1, &value.x);
+        else if constexpr (std::is_same_v<T, glm::mat2>)
+            glUniformMatrix2fv(location, 1, GL_FALSE, &value[0][0]);
+        else if constexpr (std::is_same_v<T, glm::mat3>)
+            glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]);
+        else if constexpr (std::is_same_v<T, glm::mat4>)
+            glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+        else
+            static_assert(!sizeof(T), "unsupported uniform type");
+    }
+};
+
 /**
  * Manages a single OpenGL shader.
  */
 class Shader {
     GLuint program;
+    std::map<std::string, GLint, std::less<>> uniforms;
+
+    /// Fill uniforms with the active uniforms of the linked program
+    void loadUniforms();
 
 public:
     using Ptr = std::shared_ptr<Shader>;
@@ -32,6 +97,10 @@ public:
     /**
      * Load and compile the shader from the source code.
      *
+     * When the binary cache is enabled the linked program is loaded from the
+     * cache if a binary exists for these sources and the current driver,
+     * otherwise it is compiled and the binary is saved for the next run.
+     *
      * @param vertexSource the vertex shader source
      * @param fragmentSource the fragment shader source
      *
@@ -40,6 +109,36 @@ public:
     bool loadFromSource(const std::string_view & vertexSource,
                         const std::string_view & fragmentSource);
 
+    /**
+     * Load and compile the shader from the source code, capturing varyings
+     * of the vertex shader with transform feedback, interleaved in order.
+     *
+     * @param vertexSource the vertex shader source
+     * @param fragmentSource the fragment shader source
+     * @param varyings the vertex shader outputs to capture
+     *
+     * @return was the shader compiled successfully
+     */
+    bool loadFromSource(const std::string_view & vertexSource,
+                        const std::string_view & fragmentSource,
+                        const std::vector<std::string> & varyings);
+
+    /**
+     * Set the directory used to cache linked program binaries. The default
+     * is $EGL_MATH_SHADER_CACHE, then $XDG_CACHE_HOME/egl-math, then
+     * $HOME/.cache/egl-math.
+     *
+     * @param dir the cache directory, empty to disable the cache
+     */
+    static void setBinaryCacheDir(const std::string_view & dir);
+
+    /**
+     * Get the directory used to cache linked program binaries.
+     *
+     * @return the cache directory, empty if the cache is disabled
+     */
+    static const std::string & getBinaryCacheDir();
+
     /**
      * Load and compile the shader from the given paths.
      *
@@ -51,6 +150,16 @@ public:
     bool loadFromPath(const std::string_view & vertexPath,
                       const std::string_view & fragmentPath);
 
+    /**
+     * Compile and link a compute shader program from source, needs an
+     * OpenGL 4.3 context.
+     *
+     * @param computeSource the compute shader source
+     *
+     * @return was the shader compiled successfully
+     */
+    bool loadFromComputeSource(const std::string_view & computeSource);
+
     /**
      * Get the OpenGL shader program id.
      *
@@ -69,13 +178,26 @@ public:
     void unbind() const;
 
     /**
-     * Get the uniform location for name in this shader.
+     * Get the uniform location for name in this shader. Active uniforms are
+     * read once after linking, so this is a map lookup with no GL call.
+     *
+     * @param name the uniform name
+     *
+     * @return the uniform location or -1 if name is not an active uniform
+     */
+    GLint uniformLocation(const std::string_view & name) const;
+
+    /**
+     * Get a handle for the uniform name to set it without further lookups.
      *
      * @param name the uniform name
      *
-     * @return the uniform location
+     * @return the handle, which ignores set if name is not an active uniform
      */
-    GLuint uniformLocation(const std::string_view & name) const;
+    template <typename T>
+    Uniform<T> uniform(const std::string_view & name) const {
+        return Uniform<T>(uniformLocation(name));
+    }
 
     /**
      * Get the uniform location for name and set the value to integer 0 or 1.
@@ -91,7 +213,7 @@ public:
      * @param location the uniform location
      * @param value the value to set
      */
-    void setBool(GLuint location, bool value) const;
+    void setBool(GLint location, bool value) const;
 
     /**
      * Get the uniform location for name and set the value.
@@ -107,7 +229,7 @@ public:
      * @param location the uniform location
      * @param value the value to set
      */
-    void setInt(GLuint location, int value) const;
+    void setInt(GLint location, int value) const;
 
     /**
      * Get the uniform location for name and set the value.
@@ -123,7 +245,7 @@ public:
      * @param location the uniform location
      * @param value the value to set
      */
-    void setFloat(GLuint location, float value) const;
+    void setFloat(GLint location, float value) const;
 
     /**
      * Get the uniform location for name and set the value.
@@ -139,7 +261,7 @@ public:
      * @param location the uniform location
      * @param value the value to set
      */
-    void setVec2(GLuint location, const glm::vec2 & value) const;
+    void setVec2(GLint location, const glm::vec2 & value) const;
 
     /**
      * Get the uniform location for name and set the value.
@@ -155,7 +277,7 @@ public:
      * @param location the uniform location
      * @param value the value to set
      */
-    void setVec3(GLuint location, const glm::vec3 & value) const;
+    void setVec3(GLint location, const glm::vec3 & value) const;
 
     /**
      * Get the uniform location for name and set the value.
@@ -171,7 +293,7 @@ public:
      * @param location the uniform location
      * @param value the value to set
      */
-    void setVec4(GLuint location, const glm::vec4 & value) const;
+    void setVec4(GLint location, const glm::vec4 & value) const;
 
     /**
      * Get the uniform location for name and set the value.
@@ -187,7 +309,7 @@ public:
      * @param location the uniform location
      * @param value the value to set
      */
-    void setMat2(GLuint location, const glm::mat2 & value) const;
+    void setMat2(GLint location, const glm::mat2 & value) const;
 
     /**
      * Get the uniform location for name and set the value.
@@ -203,7 +325,7 @@ public:
      * @param location the uniform location
      * @param value the value to set
      */
-    void setMat3(GLuint location, const glm::mat3 & value) const;
+    void setMat3(GLint location, const glm::mat3 & value) const;
 
     /**
      * Get the uniform location for name and set the value.
@@ -219,7 +341,7 @@ public:
      * @param location the uniform location
      * @param value the value to set
      */
-    void setMat4(GLuint location, const glm::mat4 & value) const;
+    void setMat4(GLint location, const glm::mat4 & value) const;
 
     /**
      * Load the default shader from the internal source.
@@ -254,6 +376,21 @@ public:
      */
     static Shader::Ptr fromFragmentPath(const std::string_view & path);
 
+    /**
+     * Load a shader using the default vertex shader and a fragment shader,
+     * inserting header before the fragment shader source.
+     *
+     * This is used to pick the version and #define types for sources that
+     * are shared between several table formats.
+     *
+     * @param path the path to the fragment shader source
+     * @param header the source to insert before the file
+     *
+     * @return the shader
+     */
+    static Shader::Ptr fromFragmentPath(const std::string_view & path,
+                                        const std::string_view & header);
+
     /**
      * Load a shader using the default vertex shader and a fragment shader.
      *
@@ -273,4 +410,25 @@ public:
      * @return the shader
      */
     static Shader::Ptr fromFragmentSource(const std::string_view & source);
+
+    /**
+     * Load a compute shader, see loadFromComputeSource.
+     *
+     * @param source the compute shader source
+     *
+     * @return the shader or nullptr if it failed to compile
+     */
+    static Shader::Ptr fromComputeSource(const std::string_view & source);
+
+    /**
+     * Load a vertex shader for transform feedback with an empty fragment
+     * shader, draw it with GL_RASTERIZER_DISCARD enabled.
+     *
+     * @param source the vertex shader source
+     * @param varyings the vertex shader outputs to capture
+     *
+     * @return the shader or nullptr if it failed to compile
+     */
+    static Shader::Ptr fromFeedbackSource(const std::string_view & source,
+                                          const std::vector<std::string> & varyings);
 };
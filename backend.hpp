@@ -0,0 +1,386 @@
+#pragma once
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "expr.hpp"
+#include "pipeline.hpp"
+#include "sparse.hpp"
+#include "table.hpp"
+
+/**
+ * Element wise operations supported by every Backend.
+ *
+ * The values are passed to shader.frag as the op uniform and must match the
+ * cases in calc().
+ */
+enum class Op {
+    Add = 0,
+    Sub = 1,
+    Mul = 2,
+    Div = 3,
+    Min = 4,
+    Max = 5,
+    And = 6,
+    Or = 7,
+    Xor = 8,
+};
+
+/**
+ * Find the Op with the given name, eg. add or min.
+ *
+ * @param name the lower case op name
+ *
+ * @return the op or std::nullopt if name is not an op
+ */
+inline std::optional<Op> opFromName(const std::string_view & name) {
+    static constexpr std::pair<std::string_view, Op> ops[] = {
+        {"add", Op::Add}, {"sub", Op::Sub}, {"mul", Op::Mul},
+        {"div", Op::Div}, {"min", Op::Min}, {"max", Op::Max},
+        {"and", Op::And}, {"or", Op::Or},   {"xor", Op::Xor},
+    };
+    for (auto & [opName, op] : ops) {
+        if (opName == name)
+            return op;
+    }
+    return std::nullopt;
+}
+
+/**
+ * Get the Expression source of op over the tables a and b, for backends that
+ * compile every op as an expression.
+ *
+ * @param op the op
+ *
+ * @return the source, eg. a + b
+ */
+inline const char * opExpression(Op op) {
+    switch (op) {
+        case Op::Add:
+            return "a + b";
+        case Op::Sub:
+            return "a - b";
+        case Op::Mul:
+            return "a * b";
+        case Op::Div:
+            return "a / b";
+        case Op::Min:
+            return "min(a, b)";
+        case Op::Max:
+            return "max(a, b)";
+        case Op::And:
+            return "a & b";
+        case Op::Or:
+            return "a | b";
+        case Op::Xor:
+            return "a ^ b";
+    }
+    return "a";
+}
+
+/**
+ * Is op(0, b) zero for every b of format, so a sparse left operand gives a
+ * result with its pattern. Never for floats, where 0 * b and 0 / b are -0
+ * for a negative b and 0 * inf is NaN.
+ */
+inline bool keepsSparsity(Op op, Table::Format format) {
+    return format != Table::Format::R32F
+           && (op == Op::Mul || op == Op::Div || op == Op::And);
+}
+
+/**
+ * Reductions of a whole table to a single value supported by every Backend.
+ */
+enum class Reduce {
+    /// The sum of all cells, exact for integer tables
+    Sum,
+    /// The number of non zero cells
+    Count,
+    /// The smallest cell
+    Min,
+    /// The largest cell
+    Max,
+    /// The mean of all cells, from an exact sum for integer tables
+    Mean,
+};
+
+/**
+ * The direction of a reduction over lines of a table.
+ */
+enum class Axis {
+    /// Reduce each row to one cell, giving a 1xH table
+    Rows,
+    /// Reduce each column to one cell, giving a Wx1 table
+    Columns,
+};
+
+/**
+ * Find the Reduce with the given name, one of sum, count, minimum, maximum
+ * or mean.
+ *
+ * @param name the lower case reduction name
+ *
+ * @return the reduction or std::nullopt if name is not a reduction
+ */
+inline std::optional<Reduce> reduceFromName(const std::string_view & name) {
+    static constexpr std::pair<std::string_view, Reduce> reductions[] = {
+        {"sum", Reduce::Sum},
+        {"count", Reduce::Count},
+        {"minimum", Reduce::Min},
+        {"maximum", Reduce::Max},
+        {"mean", Reduce::Mean},
+    };
+    for (auto & [reduceName, reduce] : reductions) {
+        if (reduceName == name)
+            return reduce;
+    }
+    return std::nullopt;
+}
+
+/**
+ * The result of a reduction. Sums, minimums and maximums are int64_t for
+ * R32I and RGBA8 tables, uint64_t for R32UI and double for R32F tables.
+ * Counts are always uint64_t and means double.
+ */
+using Scalar = std::variant<int64_t, uint64_t, double>;
+
+/**
+ * Get the format of the table produced by reducing the lines of a table of
+ * format. Sums, minimums and maximums keep the format, counts are R32UI
+ * and means R32F.
+ */
+inline Table::Format reduceOutputFormat(Reduce reduce, Table::Format format) {
+    switch (reduce) {
+        case Reduce::Count:
+            return Table::Format::R32UI;
+        case Reduce::Mean:
+            return Table::Format::R32F;
+        default:
+            return format;
+    }
+}
+
+/**
+ * Store the reduction of a line of cells in a cell of a table created with
+ * reduceOutputFormat. Integer sums wrap to 32 bits like element wise
+ * arithmetic.
+ *
+ * @param table the output table
+ * @param row the output row
+ * @param col the output column
+ * @param reduce the reduction
+ * @param value the reduced value, an accumulated sum for Mean
+ * @param count the number of cells reduced, the divisor for Mean
+ */
+inline void setReduced(Table & table, int row, int col, Reduce reduce,
+                       const Scalar & value, size_t count) {
+    std::visit(
+        [&](auto x) {
+            if (reduce == Reduce::Mean)
+                table.setFloat(static_cast<double>(x) / count, row, col);
+            else if (table.getFormat() == Table::Format::R32F)
+                table.setFloat(static_cast<float>(x), row, col);
+            else
+                table.setCell(static_cast<int>(static_cast<uint32_t>(x)), row, col);
+        },
+        value);
+}
+
+/**
+ * Evaluates element wise operations over tables.
+ *
+ * Division by zero gives 0 and all integer arithmetic wraps.
+ */
+class Backend {
+public:
+    using Ptr = std::shared_ptr<Backend>;
+
+    virtual ~Backend() = default;
+
+    /**
+     * Compute op(one, two) for every cell.
+     *
+     * @param op the operation
+     * @param one the left operand
+     * @param two the right operand
+     * @param name the name of the output table
+     *
+     * @return the output table or nullptr if the tables could not be used
+     */
+    virtual Table::Ptr run(Op op,
+                           const Table::Ptr & one,
+                           const Table::Ptr & two,
+                           const std::string_view & name) = 0;
+
+    /**
+     * Compute op(one, two) for every cell of a sparse one and a dense two.
+     *
+     * The default converts one to a dense table and calls run, backends
+     * that can work on the stored cells override this.
+     *
+     * @param op the operation
+     * @param one the sparse left operand
+     * @param two the right operand, the size and format of one
+     * @param name the name of the output table
+     *
+     * @return the output table or nullptr if the tables could not be used
+     */
+    virtual Table::Ptr run(Op op,
+                           const SparseTable::Ptr & one,
+                           const Table::Ptr & two,
+                           const std::string_view & name) {
+        return run(op, one->toTable(), two, name);
+    }
+
+    /**
+     * Compute op(one, two) for the stored cells of one only, for an op where
+     * keepsSparsity. The result has the pattern of one, cells that become
+     * zero stay stored.
+     *
+     * The default computes every cell with run and keeps the cells of the
+     * pattern.
+     *
+     * @param op the operation
+     * @param one the sparse left operand
+     * @param two the right operand, the size and format of one
+     * @param name the name of the output table
+     *
+     * @return the output table or nullptr if op does not keep sparsity or
+     *         the tables could not be used
+     */
+    virtual SparseTable::Ptr runSparse(Op op,
+                                       const SparseTable::Ptr & one,
+                                       const Table::Ptr & two,
+                                       const std::string_view & name) {
+        if (!keepsSparsity(op, one->getFormat())) {
+            fmt::print(stderr, "Only mul, div and and keep the sparsity of integer tables\n");
+            return nullptr;
+        }
+        auto output = run(op, one->toTable(), two, name);
+        if (!output)
+            return nullptr;
+        return SparseTable::withPattern(name, *one, one->gather(*output));
+    }
+
+    /**
+     * Evaluate expr for every cell. Each table name in expr is bound to the
+     * table in tables with that name.
+     *
+     * @param expr the expression
+     * @param tables the tables available to expr, all the same size and format
+     *
+     * @return the output table named by expr or nullptr on failure
+     */
+    virtual Table::Ptr evaluate(const Expression & expr,
+                                const std::vector<Table::Ptr> & tables) = 0;
+
+    /**
+     * Reduce every cell of table to a single value. Integer sums are
+     * accumulated in 64 bits so they do not wrap.
+     *
+     * @param reduce the reduction
+     * @param table the table to reduce, at least one cell
+     *
+     * @return the result or std::nullopt on failure
+     */
+    virtual std::optional<Scalar> reduce(Reduce reduce, const Table::Ptr & table) = 0;
+
+    /**
+     * Reduce every row or every column of table to one cell. Integer sums
+     * and means are accumulated in 64 bits.
+     *
+     * @param reduce the reduction
+     * @param axis reduce rows into a 1xH table or columns into a Wx1 table
+     * @param table the table to reduce, at least one cell
+     * @param name the name of the output table
+     *
+     * @return the output table, see reduceOutputFormat, or nullptr on failure
+     */
+    virtual Table::Ptr reduce(Reduce reduce,
+                              Axis axis,
+                              const Table::Ptr & table,
+                              const std::string_view & name) = 0;
+
+    /**
+     * Evaluate each step of pipeline in order for every cell. Step outputs
+     * are available to later steps by name.
+     *
+     * The default evaluates one step at a time, backends that can keep
+     * intermediate tables on the device override this.
+     *
+     * @param pipeline the pipeline
+     * @param tables the tables available to pipeline, all the same size and format
+     *
+     * @return the output table of the last step or nullptr on failure
+     */
+    virtual Table::Ptr evaluate(const Pipeline & pipeline,
+                                const std::vector<Table::Ptr> & tables) {
+        auto available = tables;
+        Table::Ptr result;
+        for (auto & step : pipeline.getSteps()) {
+            result = evaluate(*step, available);
+            if (!result)
+                return nullptr;
+            // In front so it shadows tables of the same name
+            available.insert(available.begin(), result);
+        }
+        return result;
+    }
+};
+
+/**
+ * Find the table for each name.
+ *
+ * @param names the table names
+ * @param tables the available tables
+ *
+ * @return the tables in the order of names or an empty vector if one is
+ *         missing
+ */
+inline std::vector<Table::Ptr> bindTables(const std::vector<std::string> & names,
+                                          const std::vector<Table::Ptr> & tables) {
+    std::vector<Table::Ptr> bound;
+    for (auto & name : names) {
+        auto it = std::find_if(tables.begin(), tables.end(),
+                               [&](auto & table) { return table->getName() == name; });
+        if (it == tables.end()) {
+            fmt::print(stderr, "No table named {}\n", name);
+            return {};
+        }
+        bound.push_back(*it);
+    }
+    return bound;
+}
+
+/**
+ * Find the table for each name used by expr.
+ *
+ * @param expr the expression
+ * @param tables the available tables
+ *
+ * @return the tables in the order of Expression::getTables or an empty
+ *         vector if one is missing
+ */
+inline std::vector<Table::Ptr> bindTables(const Expression & expr,
+                                          const std::vector<Table::Ptr> & tables) {
+    std::vector<Table::Ptr> bound;
+    for (auto & name : expr.getTables()) {
+        auto it = std::find_if(tables.begin(), tables.end(),
+                               [&](auto & table) { return table->getName() == name; });
+        if (it == tables.end()) {
+            fmt::print(stderr, "No table named {} for expression {}\n", name,
+                       expr.normalized());
+            return {};
+        }
+        bound.push_back(*it);
+    }
+    return bound;
+}
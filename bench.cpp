@@ -0,0 +1,311 @@
+#include <fmt/core.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "backend.hpp"
+#include "context.hpp"
+#include "cpu_backend.hpp"
+#include "csv.hpp"
+#include "expr.hpp"
+#include "framebuffer.hpp"
+#include "gl_backend.hpp"
+#include "table.hpp"
+#include "vbo.hpp"
+
+// Benchmarks of every stage a job goes through: parsing and writing csv,
+// uploading, compiling, drawing and reading back, plus whole runs on each
+// backend. Results are printed as JSON, progress goes to stderr.
+
+static const std::vector<int> sizes = {90, 512, 2048, 8192};
+
+// Repeat a benchmark until it ran at least this long and this often
+static const double minSeconds = 0.25;
+static const size_t minIterations = 3;
+static const size_t maxIterations = 1000;
+
+struct Result {
+    std::string name;
+    std::string backend;
+    int size;
+    size_t iterations;
+    /// mean seconds per iteration
+    double seconds;
+    /// fastest iteration
+    double best;
+    /// cells and bytes processed per iteration
+    size_t cells;
+    size_t bytes;
+};
+
+/**
+ * Time f after one warm up call.
+ *
+ * @param f the work to time, must finish it before returning, eg. glFinish
+ *
+ * @return the result with name, backend and sizes still to be filled in
+ */
+static Result measure(const std::function<void()> & f) {
+    using Clock = std::chrono::steady_clock;
+
+    f();
+
+    Result result {};
+    double total = 0;
+    result.best = 1e300;
+    while (result.iterations < maxIterations
+           && (total < minSeconds || result.iterations < minIterations)) {
+        auto start = Clock::now();
+        f();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        total += seconds;
+        result.best = std::min(result.best, seconds);
+        result.iterations++;
+    }
+    result.seconds = total / result.iterations;
+    return result;
+}
+
+class Bench {
+    std::vector<Result> results;
+
+public:
+    void run(const std::string_view & name,
+             const std::string_view & backend,
+             int size,
+             size_t bytes,
+             const std::function<void()> & f) {
+        auto result = measure(f);
+        result.name = name;
+        result.backend = backend;
+        result.size = size;
+        result.cells = static_cast<size_t>(size) * size;
+        result.bytes = bytes;
+        fmt::print(stderr, "{:<16} {:<5} {:>5}x{:<5} {:>10.3f} ms {:>10.1f} Mcells/s\n",
+                   name, backend, size, size, result.seconds * 1e3,
+                   result.cells / result.seconds / 1e6);
+        results.push_back(result);
+    }
+
+    std::string json(const std::string_view & format) const {
+        std::string out = fmt::format("{{\n  \"format\": \"{}\",\n  \"benchmarks\": [", format);
+        for (size_t i = 0; i < results.size(); i++) {
+            auto & r = results[i];
+            out += fmt::format("{}\n    {{\"name\": \"{}\", \"backend\": \"{}\", "
+                               "\"width\": {}, \"height\": {}, \"iterations\": {}, "
+                               "\"seconds\": {:.9g}, \"best_seconds\": {:.9g}, "
+                               "\"cells_per_second\": {:.6g}, \"bytes_per_second\": {:.6g}}}",
+                               i ? "," : "", r.name, r.backend, r.size, r.size,
+                               r.iterations, r.seconds, r.best, r.cells / r.seconds,
+                               r.bytes / r.seconds);
+        }
+        out += "\n  ]\n}\n";
+        return out;
+    }
+};
+
+static Table::Ptr random_table(const std::string_view & name,
+                               int size,
+                               Table::Format format,
+                               std::mt19937 & rng) {
+    auto table = std::make_shared<Table>(name, size, size, format);
+    std::uniform_int_distribution<int> dist(-1000, 1000);
+    for (int row = 0; row < size; row++) {
+        for (int col = 0; col < size; col++) {
+            if (format == Table::Format::R32F)
+                table->setFloat(dist(rng) / 8.0f, row, col);
+            else if (format == Table::Format::R32UI)
+                table->setCell(dist(rng) + 1000, row, col);
+            else
+                table->setCell(dist(rng), row, col);
+        }
+    }
+    return table;
+}
+
+static size_t file_size(const std::string & path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+static void bench_csv(Bench & bench, const Table::Ptr & table, Table::Format format) {
+    int size = table->getWidth();
+    auto path = fmt::format("bench-{}.csv", size);
+
+    write_csv(path, *table);
+    auto bytes = file_size(path);
+
+    bench.run("write_csv", "host", size, bytes, [&] { write_csv(path, *table); });
+    bench.run("read_csv", "host", size, bytes, [&] { read_csv(path, format); });
+    unlink(path.c_str());
+}
+
+static void bench_gl(Bench & bench, const std::vector<Table::Ptr> & ones,
+                     const std::vector<Table::Ptr> & twos, Table::Format format) {
+    Context context(1024, 1024);
+    context.makeCurrent();
+
+    auto expr = Expression::parse("one + two");
+    if (!expr)
+        return;
+    auto source = expr->fragmentSource(format);
+
+    // Compile from source every time, then load the cached binary
+    auto cacheDir = Shader::getBinaryCacheDir();
+    Shader::setBinaryCacheDir("");
+    bench.run("shader_compile", "egl", 0, source.size(), [&] {
+        Shader::fromFragmentSource(source);
+    });
+    Shader::setBinaryCacheDir(cacheDir);
+    if (!cacheDir.empty()) {
+        bench.run("shader_cached", "egl", 0, source.size(), [&] {
+            Shader::fromFragmentSource(source);
+        });
+    }
+
+    auto shader = Shader::fromFragmentSource(source);
+    if (!shader)
+        return;
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    VBO quad;
+    quad.loadFromPoints(fullscreen_quad());
+
+    for (size_t i = 0; i < ones.size(); i++) {
+        int size = ones[i]->getWidth();
+        if (size > maxTextureSize) {
+            fmt::print(stderr, "Skipping {0}x{0}, larger than GL_MAX_TEXTURE_SIZE\n", size);
+            continue;
+        }
+        size_t bytes = static_cast<size_t>(size) * size * sizeof(int);
+
+        // Copies, so the textures of the shared tables stay in no context
+        std::vector<int> cells(ones[i]->data(), ones[i]->data() + size * size);
+        auto one = std::make_shared<Table>("one", size, size, format);
+        bench.run("loadTable", "egl", size, bytes, [&] {
+            one->loadTable(cells);
+            glFinish();
+        });
+        auto two = Table::fromTable(
+            "two", std::vector<int>(twos[i]->data(), twos[i]->data() + size * size), size,
+            size, format);
+
+        auto output = std::make_shared<Table>("output", size, size, format);
+        output->allocate();
+        Framebuffer fbo;
+        if (!fbo.attach(*output)) {
+            fmt::print(stderr, "Framebuffer incomplete for {0}x{0}\n", size);
+            fbo.unbind();
+            continue;
+        }
+
+        GLState::viewport(0, 0, size, size);
+        shader->bind();
+        shader->setInt("width", size);
+        shader->setInt("height", size);
+        one->bind(0, shader, "one");
+        two->bind(1, shader, "two");
+
+        bench.run("draw", "egl", size, 2 * bytes, [&] {
+            quad.draw();
+            glFinish();
+        });
+
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        bench.run("readFromPixels", "egl", size, bytes, [&] { output->readFromPixels(); });
+
+        fbo.unbind();
+    }
+}
+
+static void bench_backend(Bench & bench, const std::string_view & name,
+                          const std::vector<Table::Ptr> & ones,
+                          const std::vector<Table::Ptr> & twos) {
+    Backend::Ptr backend;
+    if (name == "cpu")
+        backend = std::make_shared<CPUBackend>();
+    else
+        backend = std::make_shared<GLBackend>(1024, 1024, "..");
+
+    for (size_t i = 0; i < ones.size(); i++) {
+        int size = ones[i]->getWidth();
+        size_t bytes = static_cast<size_t>(size) * size * sizeof(int);
+        bench.run("run_add", name, size, 3 * bytes, [&] {
+            backend->run(Op::Add, ones[i], twos[i], "output");
+        });
+    }
+}
+
+int main(int argc, char ** argv) {
+    std::string_view backendName = argc > 1 ? argv[1] : "all";
+    std::string_view formatName = argc > 2 ? argv[2] : "r32i";
+    std::string_view maxSizeText = argc > 3 ? argv[3] : "8192";
+    std::string_view outputPath = argc > 4 ? argv[4] : "";
+
+    if (backendName != "cpu" && backendName != "egl" && backendName != "all") {
+        fmt::print(stderr, "Unknown backend {}, expected cpu, egl or all\n", backendName);
+        return 1;
+    }
+
+    auto format = formatFromName(formatName);
+    if (!format) {
+        fmt::print(stderr, "Unknown format {}\n", formatName);
+        return 1;
+    }
+
+    int maxSize = 0;
+    auto res = std::from_chars(maxSizeText.data(), maxSizeText.data() + maxSizeText.size(),
+                               maxSize);
+    if (res.ec != std::errc() || res.ptr != maxSizeText.data() + maxSizeText.size()) {
+        fmt::print(stderr, "Invalid maximum size {}\n", maxSizeText);
+        return 1;
+    }
+
+    std::mt19937 rng(42);
+    std::vector<Table::Ptr> ones, twos;
+    for (int size : sizes) {
+        if (size > maxSize)
+            break;
+        ones.push_back(random_table("one", size, *format, rng));
+        twos.push_back(random_table("two", size, *format, rng));
+    }
+
+    Bench bench;
+    for (auto & one : ones) {
+        bench_csv(bench, one, *format);
+    }
+
+    if (backendName != "cpu")
+        bench_gl(bench, ones, twos, *format);
+
+    if (backendName != "egl")
+        bench_backend(bench, "cpu", ones, twos);
+    if (backendName != "cpu")
+        bench_backend(bench, "egl", ones, twos);
+
+    auto json = bench.json(formatName);
+    if (outputPath.empty()) {
+        fmt::print("{}", json);
+        return 0;
+    }
+
+    auto file = std::fopen(std::string(outputPath).c_str(), "w");
+    if (!file) {
+        fmt::print(stderr, "Could not open {}\n", outputPath);
+        return 1;
+    }
+    fmt::print(file, "{}", json);
+    std::fclose(file);
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "compute_backend.hpp"
+
+#include <GLES3/gl31.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "pipeline.hpp"
+#include "trace.hpp"
+
+ComputeBackend::ComputeBackend(unsigned threads)
+    : context(1, 1), supported(false), maxGroups(0), maxBlockBytes(0), host(threads) {
+    context.makeCurrent();
+
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    supported = major > 4 || (major == 4 && minor >= 3);
+    if (!supported) {
+        fmt::print(stderr, "ComputeBackend needs OpenGL 4.3, the context is {}.{}\n", major,
+                   minor);
+        return;
+    }
+
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxGroups);
+    GLint64 blockSize = 0;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &blockSize);
+    maxBlockBytes = blockSize;
+}
+
+bool ComputeBackend::isSupported() const {
+    return supported;
+}
+
+Shader::Ptr ComputeBackend::shaderFor(const std::string & key, const std::string & source) {
+    auto it = programs.find(key);
+    if (it != programs.end())
+        return it->second;
+
+    auto shader = Shader::fromComputeSource(source);
+    if (shader)
+        programs[key] = shader;
+    return shader;
+}
+
+StorageBuffer::Ptr ComputeBackend::buffer(GLsizeiptr size) {
+    for (auto & buffer : buffers) {
+        if (buffer.use_count() == 1 && buffer->getSize() == size)
+            return buffer;
+    }
+
+    auto buffer = std::make_shared<StorageBuffer>(size);
+    buffers.push_back(buffer);
+    return buffer;
+}
+
+bool ComputeBackend::check(const std::vector<Table::Ptr> & inputs, bool bitwise) {
+    if (!supported) {
+        fmt::print(stderr, "ComputeBackend compute shaders are not supported\n");
+        return false;
+    }
+
+    auto & first = inputs[0];
+    for (auto & input : inputs) {
+        if (input->getWidth() != first->getWidth() || input->getHeight() != first->getHeight()) {
+            fmt::print(stderr, "ComputeBackend input size mismatch {}x{} != {}x{}\n",
+                       input->getWidth(), input->getHeight(), first->getWidth(),
+                       first->getHeight());
+            return false;
+        }
+        if (input->getFormat() != first->getFormat()) {
+            fmt::print(stderr, "ComputeBackend input {} format does not match {}\n",
+                       input->getName(), first->getName());
+            return false;
+        }
+    }
+
+    if (bitwise && first->getFormat() == Table::Format::R32F) {
+        fmt::print(stderr, "ComputeBackend bitwise ops are not supported for float tables\n");
+        return false;
+    }
+    return true;
+}
+
+Table::Ptr ComputeBackend::dispatch(const Shader::Ptr & shader,
+                                    const std::vector<Table::Ptr> & inputs,
+                                    const std::string_view & name) {
+    auto & first = inputs[0];
+    size_t cells = static_cast<size_t>(first->getWidth()) * first->getHeight();
+    auto output = Table::uninitialized(name, first->getWidth(), first->getHeight(),
+                                       first->getFormat());
+    if (cells == 0)
+        return output;
+
+    // Every buffer holds a chunk of cells that fits one storage block
+    size_t chunk = std::min(cells, std::max<size_t>(maxBlockBytes / sizeof(int), 1));
+    GLsizeiptr chunkBytes = chunk * sizeof(int);
+
+    std::vector<StorageBuffer::Ptr> bound;
+    for (size_t i = 0; i <= inputs.size(); i++) {
+        bound.push_back(buffer(chunkBytes));
+        bound.back()->bindBase(i);
+    }
+
+    shader->bind();
+    auto count = shader->uniform<unsigned>("count");
+
+    for (size_t offset = 0; offset < cells; offset += chunk) {
+        size_t n = std::min(chunk, cells - offset);
+        GLsizeiptr bytes = n * sizeof(int);
+
+        for (size_t i = 0; i < inputs.size(); i++) {
+            TRACE_SCOPE("upload");
+            bound[i]->write(inputs[i]->data() + offset, bytes);
+        }
+
+        count.set(n);
+        GLuint groups = (n + Expression::computeGroupSize - 1) / Expression::computeGroupSize;
+        GLuint groupsX = std::min<GLuint>(groups, maxGroups);
+        GLuint groupsY = (groups + groupsX - 1) / groupsX;
+        {
+            TRACE_GL_SCOPE("dispatch");
+            glDispatchCompute(groupsX, groupsY, 1);
+        }
+
+        // Make the shader writes visible to the mapping
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        TRACE_SCOPE("readback");
+        auto & result = bound.back();
+        auto mapped = result->mapRead(bytes);
+        if (!mapped) {
+            fmt::print(stderr, "ComputeBackend could not map the output of {}\n", name);
+            return nullptr;
+        }
+        std::memcpy(output->data() + offset, mapped, bytes);
+        result->unmap();
+    }
+
+    return output;
+}
+
+Table::Ptr ComputeBackend::run(Op op,
+                               const Table::Ptr & one,
+                               const Table::Ptr & two,
+                               const std::string_view & name) {
+    bool bitwise = op == Op::And || op == Op::Or || op == Op::Xor;
+    if (!check({one, two}, bitwise))
+        return nullptr;
+
+    auto expr = Expression::parse(opExpression(op));
+    auto format = one->getFormat();
+    auto key = fmt::format("{}:{}", static_cast<int>(format), expr->normalized());
+    auto shader = shaderFor(key, expr->computeSource(format));
+    if (!shader)
+        return nullptr;
+
+    return dispatch(shader, {one, two}, name);
+}
+
+Table::Ptr ComputeBackend::evaluate(const Expression & expr,
+                                    const std::vector<Table::Ptr> & tables) {
+    if (expr.getTables().empty()) {
+        fmt::print(stderr, "ComputeBackend expression {} uses no tables\n", expr.normalized());
+        return nullptr;
+    }
+
+    auto inputs = bindTables(expr, tables);
+    if (inputs.empty() || !check(inputs, expr.usesBitwise()))
+        return nullptr;
+
+    auto format = inputs[0]->getFormat();
+    auto key = fmt::format("{}:{}", static_cast<int>(format), expr.normalized());
+    auto shader = shaderFor(key, expr.computeSource(format));
+    if (!shader)
+        return nullptr;
+
+    return dispatch(shader, inputs, expr.getOutput());
+}
+
+Table::Ptr ComputeBackend::evaluate(const Pipeline & pipeline,
+                                    const std::vector<Table::Ptr> & tables) {
+    auto names = pipeline.getInputs();
+    if (names.empty()) {
+        fmt::print(stderr, "ComputeBackend pipeline uses no tables\n");
+        return nullptr;
+    }
+
+    auto inputs = bindTables(names, tables);
+    if (inputs.empty() || !check(inputs, pipeline.usesBitwise()))
+        return nullptr;
+
+    auto format = inputs[0]->getFormat();
+    auto key = fmt::format("{}:{}", static_cast<int>(format), pipeline.normalized());
+    auto shader = shaderFor(key, pipeline.computeSource(format));
+    if (!shader)
+        return nullptr;
+
+    return dispatch(shader, inputs, pipeline.getOutput());
+}
+
+Table::Ptr ComputeBackend::run(Op op,
+                               const SparseTable::Ptr & one,
+                               const Table::Ptr & two,
+                               const std::string_view & name) {
+    return host.run(op, one, two, name);
+}
+
+SparseTable::Ptr ComputeBackend::runSparse(Op op,
+                                           const SparseTable::Ptr & one,
+                                           const Table::Ptr & two,
+                                           const std::string_view & name) {
+    return host.runSparse(op, one, two, name);
+}
+
+std::optional<Scalar> ComputeBackend::reduce(Reduce reduce, const Table::Ptr & table) {
+    return host.reduce(reduce, table);
+}
+
+Table::Ptr ComputeBackend::reduce(Reduce reduce,
+                                  Axis axis,
+                                  const Table::Ptr & table,
+                                  const std::string_view & name) {
+    return host.reduce(reduce, axis, table, name);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Shader.hpp"
+#include "backend.hpp"
+#include "context.hpp"
+#include "cpu_backend.hpp"
+#include "ssbo.hpp"
+
+/**
+ * Backend that evaluates ops with compute shaders over shader storage
+ * buffers, needs an OpenGL 4.3 context.
+ *
+ * Tables are flat arrays of width * height cells, so there is no tiling,
+ * rasterization or readback through a framebuffer: the cells are copied to
+ * a buffer, one invocation computes each output cell and the output buffer
+ * is mapped back. Tables larger than the largest storage block are computed
+ * in chunks. Expressions and fused pipelines are compiled to their own
+ * compute shader, cached like the GLBackend shaders. Reductions run on the
+ * host with a CPUBackend.
+ */
+class ComputeBackend : public Backend {
+    Context context;
+    bool supported;
+    GLint maxGroups;
+    GLsizeiptr maxBlockBytes;
+    std::unordered_map<std::string, Shader::Ptr> programs;
+    std::vector<StorageBuffer::Ptr> buffers;
+    CPUBackend host;
+
+    Shader::Ptr shaderFor(const std::string & key, const std::string & source);
+
+    StorageBuffer::Ptr buffer(GLsizeiptr size);
+
+    bool check(const std::vector<Table::Ptr> & inputs, bool bitwise);
+
+    /**
+     * Dispatch shader over every cell of inputs, bound in order.
+     */
+    Table::Ptr dispatch(const Shader::Ptr & shader,
+                        const std::vector<Table::Ptr> & inputs,
+                        const std::string_view & name);
+
+public:
+    /**
+     * Create the context and make it current.
+     *
+     * @param threads the number of threads of the host reductions, 0 to use
+     *        one per core
+     */
+    ComputeBackend(unsigned threads = 0);
+
+    /**
+     * Does the context support compute shaders, the ops fail if not.
+     */
+    bool isSupported() const;
+
+    Table::Ptr run(Op op,
+                   const Table::Ptr & one,
+                   const Table::Ptr & two,
+                   const std::string_view & name) override;
+
+    /**
+     * Run on the host, the stored cells of one are not worth a dispatch.
+     */
+    Table::Ptr run(Op op,
+                   const SparseTable::Ptr & one,
+                   const Table::Ptr & two,
+                   const std::string_view & name) override;
+
+    SparseTable::Ptr runSparse(Op op,
+                               const SparseTable::Ptr & one,
+                               const Table::Ptr & two,
+                               const std::string_view & name) override;
+
+    Table::Ptr evaluate(const Expression & expr,
+                        const std::vector<Table::Ptr> & tables) override;
+
+    /**
+     * Dispatch the fused steps of pipeline once over every cell.
+     */
+    Table::Ptr evaluate(const Pipeline & pipeline,
+                        const std::vector<Table::Ptr> & tables) override;
+
+    std::optional<Scalar> reduce(Reduce reduce, const Table::Ptr & table) override;
+
+    Table::Ptr reduce(Reduce reduce,
+                      Axis axis,
+                      const Table::Ptr & table,
+                      const std::string_view & name) override;
+};
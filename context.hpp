@@ -1,7 +1,12 @@
 #pragma once
 
 #include <EGL/egl.h>
-#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
+
+#include <mutex>
+
+#include "gl_state.hpp"
+#include "trace.hpp"
 
 static const EGLint configAttribs[] = {EGL_SURFACE_TYPE,
                                        EGL_PBUFFER_BIT,
@@ -19,7 +24,17 @@ static const EGLint configAttribs[] = {EGL_SURFACE_TYPE,
                                        EGL_OPENGL_BIT,
                                        EGL_NONE};
 
+/**
+ * An EGL pbuffer surface and OpenGL context. A context is current on one
+ * thread at a time, use one Context per thread to render in parallel.
+ */
 class Context {
+    // The display is shared by every Context and terminated with the last.
+    // The lock keeps a new context from initializing it while the last one
+    // terminates it.
+    static inline std::mutex displayLock;
+    static inline int live = 0;
+
     EGLDisplay eglDpy;
     EGLint major, minor;
     EGLSurface eglSurf;
@@ -27,11 +42,18 @@ class Context {
 
     int width, height;
 
+    // The bindings of this context, used by GLState while it is current
+    mutable GLState state;
+
 public:
     Context(int width, int height) : width(width), height(height) {
+        TRACE_SCOPE("context");
         eglDpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-
-        eglInitialize(eglDpy, &major, &minor);
+        {
+            std::lock_guard<std::mutex> lock(displayLock);
+            eglInitialize(eglDpy, &major, &minor);
+            live++;
+        }
 
         EGLint numConfigs;
         EGLConfig eglCfg;
@@ -47,8 +69,19 @@ public:
         eglCtx = eglCreateContext(eglDpy, eglCfg, EGL_NO_CONTEXT, nullptr);
     }
 
+    Context(const Context &) = delete;
+    Context & operator=(const Context &) = delete;
+
     ~Context() {
-        eglTerminate(eglDpy);
+        if (eglGetCurrentContext() == eglCtx)
+            eglMakeCurrent(eglDpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (GLState::getCurrent() == &state)
+            GLState::makeCurrent(nullptr);
+        eglDestroyContext(eglDpy, eglCtx);
+        eglDestroySurface(eglDpy, eglSurf);
+        std::lock_guard<std::mutex> lock(displayLock);
+        if (--live == 0)
+            eglTerminate(eglDpy);
     }
 
     int getWidth() const {
@@ -61,5 +94,6 @@ public:
 
     void makeCurrent() const {
         eglMakeCurrent(eglDpy, eglSurf, eglSurf, eglCtx);
+        GLState::makeCurrent(&state);
     }
 };
\ No newline at end of file
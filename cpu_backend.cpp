@@ -0,0 +1,979 @@
+#include "cpu_backend.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EGL_MATH_X86 1
+#include <immintrin.h>
+#endif
+
+// Below this many cells the cost of starting threads outweighs the work
+static const size_t minCellsPerThread = 1 << 16;
+
+namespace {
+
+// Each kernel provides a scalar version and, when vectorized is true, AVX2
+// and SSE versions operating on 8 and 4 lanes. Signed arithmetic goes through
+// unsigned to wrap like GLSL instead of overflowing.
+
+struct Add {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return static_cast<int>(static_cast<unsigned>(a) + static_cast<unsigned>(b));
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_add_epi32(a, b);
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_add_epi32(a, b);
+    }
+#endif
+};
+
+struct Sub {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return static_cast<int>(static_cast<unsigned>(a) - static_cast<unsigned>(b));
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_sub_epi32(a, b);
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_sub_epi32(a, b);
+    }
+#endif
+};
+
+struct Mul {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return static_cast<int>(static_cast<unsigned>(a) * static_cast<unsigned>(b));
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_mullo_epi32(a, b);
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_mullo_epi32(a, b);
+    }
+#endif
+};
+
+struct Div {
+    static constexpr bool vectorized = false;
+    static int scalar(int a, int b) {
+        if (b == 0)
+            return 0;
+        if (a == INT_MIN && b == -1)
+            return INT_MIN;
+        return a / b;
+    }
+};
+
+struct Min {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return std::min(a, b);
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_min_epi32(a, b);
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_min_epi32(a, b);
+    }
+#endif
+};
+
+struct Max {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return std::max(a, b);
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_max_epi32(a, b);
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_max_epi32(a, b);
+    }
+#endif
+};
+
+struct And {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return a & b;
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_and_si256(a, b);
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_and_si128(a, b);
+    }
+#endif
+};
+
+struct Or {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return a | b;
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_or_si256(a, b);
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_or_si128(a, b);
+    }
+#endif
+};
+
+struct Xor {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return a ^ b;
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_xor_si256(a, b);
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_xor_si128(a, b);
+    }
+#endif
+};
+
+// Unsigned kernels, used for R32UI tables where the signed versions differ
+
+struct UMin {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return static_cast<unsigned>(a) < static_cast<unsigned>(b) ? a : b;
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_min_epu32(a, b);
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_min_epu32(a, b);
+    }
+#endif
+};
+
+struct UMax {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return static_cast<unsigned>(a) > static_cast<unsigned>(b) ? a : b;
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_max_epu32(a, b);
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_max_epu32(a, b);
+    }
+#endif
+};
+
+struct UDiv {
+    static constexpr bool vectorized = false;
+    static int scalar(int a, int b) {
+        if (b == 0)
+            return 0;
+        return static_cast<int>(static_cast<unsigned>(a) / static_cast<unsigned>(b));
+    }
+};
+
+// Float kernels, used for R32F tables. Cells hold the float bits.
+
+inline float asFloat(int bits) {
+    float val;
+    std::memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+inline int asBits(float val) {
+    int bits;
+    std::memcpy(&bits, &val, sizeof(bits));
+    return bits;
+}
+
+struct FAdd {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return asBits(asFloat(a) + asFloat(b));
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_castps_si256(
+            _mm256_add_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b)));
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+    }
+#endif
+};
+
+struct FSub {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return asBits(asFloat(a) - asFloat(b));
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_castps_si256(
+            _mm256_sub_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b)));
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_castps_si128(_mm_sub_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+    }
+#endif
+};
+
+struct FMul {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return asBits(asFloat(a) * asFloat(b));
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_castps_si256(
+            _mm256_mul_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b)));
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_castps_si128(_mm_mul_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+    }
+#endif
+};
+
+struct FDiv {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        if (asFloat(b) == 0.0f)
+            return asBits(0.0f);
+        return asBits(asFloat(a) / asFloat(b));
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        __m256 fb = _mm256_castsi256_ps(b);
+        __m256 zero = _mm256_cmp_ps(fb, _mm256_setzero_ps(), _CMP_EQ_OQ);
+        __m256 res = _mm256_div_ps(_mm256_castsi256_ps(a), fb);
+        return _mm256_castps_si256(_mm256_andnot_ps(zero, res));
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        __m128 fb = _mm_castsi128_ps(b);
+        __m128 zero = _mm_cmpeq_ps(fb, _mm_setzero_ps());
+        __m128 res = _mm_div_ps(_mm_castsi128_ps(a), fb);
+        return _mm_castps_si128(_mm_andnot_ps(zero, res));
+    }
+#endif
+};
+
+// Scalar min and max pick the same operand as minps and maxps for NaN
+
+struct FMin {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return asFloat(a) < asFloat(b) ? a : b;
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_castps_si256(
+            _mm256_min_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b)));
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_castps_si128(_mm_min_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+    }
+#endif
+};
+
+struct FMax {
+    static constexpr bool vectorized = true;
+    static int scalar(int a, int b) {
+        return asFloat(a) > asFloat(b) ? a : b;
+    }
+#ifdef EGL_MATH_X86
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i a, __m256i b) {
+        return _mm256_castps_si256(
+            _mm256_max_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b)));
+    }
+    __attribute__((target("sse4.1"))) static __m128i sse(__m128i a, __m128i b) {
+        return _mm_castps_si128(_mm_max_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+    }
+#endif
+};
+
+template <typename Kernel>
+void applyScalar(const int * a, const int * b, int * out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = Kernel::scalar(a[i], b[i]);
+    }
+}
+
+#ifdef EGL_MATH_X86
+template <typename Kernel>
+__attribute__((target("avx2"))) void applyAVX2(const int * a, const int * b, int * out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), Kernel::avx2(va, vb));
+    }
+    applyScalar<Kernel>(a + i, b + i, out + i, n - i);
+}
+
+template <typename Kernel>
+__attribute__((target("sse4.1"))) void applySSE(const int * a, const int * b, int * out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), Kernel::sse(va, vb));
+    }
+    applyScalar<Kernel>(a + i, b + i, out + i, n - i);
+}
+#endif
+
+template <typename Kernel>
+void apply(const int * a, const int * b, int * out, size_t n) {
+#ifdef EGL_MATH_X86
+    if constexpr (Kernel::vectorized) {
+        static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+        static const bool hasSSE41 = __builtin_cpu_supports("sse4.1");
+        if (hasAVX2)
+            return applyAVX2<Kernel>(a, b, out, n);
+        if (hasSSE41)
+            return applySSE<Kernel>(a, b, out, n);
+    }
+#endif
+    applyScalar<Kernel>(a, b, out, n);
+}
+
+using KernelFn = void (*)(const int *, const int *, int *, size_t);
+
+KernelFn floatKernelFor(Op op) {
+    switch (op) {
+        case Op::Add:
+            return apply<FAdd>;
+        case Op::Sub:
+            return apply<FSub>;
+        case Op::Mul:
+            return apply<FMul>;
+        case Op::Div:
+            return apply<FDiv>;
+        case Op::Min:
+            return apply<FMin>;
+        case Op::Max:
+            return apply<FMax>;
+        default:
+            return nullptr;
+    }
+}
+
+KernelFn kernelFor(Op op, Table::Format format) {
+    if (format == Table::Format::R32F)
+        return floatKernelFor(op);
+
+    bool isUnsigned = format == Table::Format::R32UI;
+
+    switch (op) {
+        case Op::Add:
+            return apply<Add>;
+        case Op::Sub:
+            return apply<Sub>;
+        case Op::Mul:
+            return apply<Mul>;
+        case Op::Div:
+            return isUnsigned ? apply<UDiv> : apply<Div>;
+        case Op::Min:
+            return isUnsigned ? apply<UMin> : apply<Min>;
+        case Op::Max:
+            return isUnsigned ? apply<UMax> : apply<Max>;
+        case Op::And:
+            return apply<And>;
+        case Op::Or:
+            return apply<Or>;
+        case Op::Xor:
+            return apply<Xor>;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+CPUBackend::CPUBackend(unsigned threads) : threads(threads) {
+    if (this->threads == 0)
+        this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+Table::Ptr CPUBackend::run(Op op,
+                           const Table::Ptr & one,
+                           const Table::Ptr & two,
+                           const std::string_view & name) {
+    int width = one->getWidth();
+    int height = one->getHeight();
+
+    if (two->getWidth() != width || two->getHeight() != height) {
+        fmt::print(stderr, "CPUBackend input size mismatch {}x{} != {}x{}\n",
+                   two->getWidth(), two->getHeight(), width, height);
+        return nullptr;
+    }
+
+    auto format = one->getFormat();
+    if (two->getFormat() != format) {
+        fmt::print(stderr, "CPUBackend input {} format does not match {}\n",
+                   two->getName(), one->getName());
+        return nullptr;
+    }
+
+    auto kernel = kernelFor(op, format);
+    if (!kernel) {
+        fmt::print(stderr, "CPUBackend bitwise ops are not supported for float tables\n");
+        return nullptr;
+    }
+
+    auto output = Table::uninitialized(name, width, height, format);
+
+    const int * a = one->data();
+    const int * b = two->data();
+    int * out = output->data();
+
+    size_t cells = static_cast<size_t>(width) * height;
+    size_t workers = std::min<size_t>(threads, cells / minCellsPerThread);
+    workers = std::min<size_t>(workers, height);
+
+    if (workers <= 1) {
+        kernel(a, b, out, cells);
+        return output;
+    }
+
+    // Split whole rows so each worker writes a contiguous range
+    std::vector<std::thread> pool;
+    size_t rowsPerWorker = (height + workers - 1) / workers;
+    for (size_t row = 0; row < static_cast<size_t>(height); row += rowsPerWorker) {
+        size_t begin = row * width;
+        size_t end = std::min<size_t>(row + rowsPerWorker, height) * width;
+        pool.emplace_back(kernel, a + begin, b + begin, out + begin, end - begin);
+    }
+    for (auto & t : pool) {
+        t.join();
+    }
+
+    return output;
+}
+
+namespace {
+
+/**
+ * Check that a sparse and a dense operand can be used together.
+ *
+ * @return the kernel of op or nullptr if not, the reason is printed
+ */
+KernelFn sparseKernelFor(Op op, const SparseTable & one, const Table & two) {
+    if (two.getWidth() != one.getWidth() || two.getHeight() != one.getHeight()) {
+        fmt::print(stderr, "CPUBackend input size mismatch {}x{} != {}x{}\n", two.getWidth(),
+                   two.getHeight(), one.getWidth(), one.getHeight());
+        return nullptr;
+    }
+
+    if (two.getFormat() != one.getFormat()) {
+        fmt::print(stderr, "CPUBackend input {} format does not match {}\n", two.getName(),
+                   one.getName());
+        return nullptr;
+    }
+
+    auto kernel = kernelFor(op, one.getFormat());
+    if (!kernel)
+        fmt::print(stderr, "CPUBackend bitwise ops are not supported for float tables\n");
+    return kernel;
+}
+
+} // namespace
+
+Table::Ptr CPUBackend::run(Op op,
+                           const SparseTable::Ptr & one,
+                           const Table::Ptr & two,
+                           const std::string_view & name) {
+    auto kernel = sparseKernelFor(op, *one, *two);
+    if (!kernel)
+        return nullptr;
+
+    int width = one->getWidth();
+    auto output = Table::uninitialized(name, width, one->getHeight(), one->getFormat());
+
+    // Every cell missing from one is op(0, two)
+    std::vector<int> zeros(width, 0);
+    for (int r = 0; r < one->getHeight(); r++) {
+        size_t begin = static_cast<size_t>(r) * width;
+        kernel(zeros.data(), two->data() + begin, output->data() + begin, width);
+    }
+
+    auto & rowStart = one->getRowStart();
+    auto & columns = one->getColumns();
+    auto cells = one->gather(*two);
+    kernel(one->getValues().data(), cells.data(), cells.data(), cells.size());
+    for (int r = 0; r < one->getHeight(); r++) {
+        int * row = output->data() + static_cast<size_t>(r) * width;
+        for (size_t i = rowStart[r]; i < rowStart[r + 1]; i++) {
+            row[columns[i]] = cells[i];
+        }
+    }
+
+    return output;
+}
+
+SparseTable::Ptr CPUBackend::runSparse(Op op,
+                                       const SparseTable::Ptr & one,
+                                       const Table::Ptr & two,
+                                       const std::string_view & name) {
+    if (!keepsSparsity(op, one->getFormat())) {
+        fmt::print(stderr, "Only mul, div and and keep the sparsity of integer tables\n");
+        return nullptr;
+    }
+
+    auto kernel = sparseKernelFor(op, *one, *two);
+    if (!kernel)
+        return nullptr;
+
+    auto cells = one->gather(*two);
+    kernel(one->getValues().data(), cells.data(), cells.data(), cells.size());
+    return SparseTable::withPattern(name, *one, std::move(cells));
+}
+
+namespace {
+
+// Cells of an expression evaluated at a time, small enough that the values of
+// every node stay in cache
+const size_t evalBlockCells = 4096;
+
+/**
+ * Evaluates an expression tree one block of cells at a time. Each node
+ * writes its block to a buffer of the thread and literals are broadcast into
+ * one block up front, so no table is allocated for constants or
+ * intermediate values.
+ */
+class Evaluator {
+    using Node = Expression::Node;
+
+    /**
+     * The block buffers of one thread. The node at slot writes to buffer
+     * slot, its arguments to slot + 1 and slot + 2, so no argument
+     * overwrites the other before the node reads them.
+     */
+    class Scratch {
+        std::vector<std::vector<int>> buffers;
+
+    public:
+        int * buffer(size_t slot) {
+            if (slot >= buffers.size())
+                buffers.resize(slot + 1);
+            if (buffers[slot].empty())
+                buffers[slot].resize(evalBlockCells);
+            return buffers[slot].data();
+        }
+    };
+
+    const std::vector<Table::Ptr> & inputs;
+    const std::vector<std::string> & names;
+    const Node & root;
+    Table::Format format;
+    std::vector<int> zeros;
+    std::unordered_map<const Node *, std::vector<int>> literals;
+
+    /**
+     * Get the cell bits of a literal, which the parser has already checked.
+     * Fractional literals are truncated and clamped to the integer formats.
+     */
+    int literalBits(const Node & node) const {
+        bool isInteger = node.text.find_first_of(".en") == std::string::npos;
+        int bits;
+        if (format == Table::Format::R32F) {
+            float val = static_cast<float>(node.value);
+            std::memcpy(&bits, &val, sizeof(bits));
+        }
+        else if (isInteger) {
+            bits = static_cast<int>(static_cast<unsigned>(node.value));
+        }
+        else if (format == Table::Format::R32UI) {
+            bits = static_cast<int>(static_cast<unsigned>(std::clamp(node.value, 0.0,
+                                                                     double(UINT_MAX))));
+        }
+        else {
+            bits = static_cast<int>(std::clamp(node.value, double(INT_MIN), double(INT_MAX)));
+        }
+        return bits;
+    }
+
+    void broadcastLiterals(const Node & node) {
+        if (node.kind == Node::Kind::Number)
+            literals.emplace(&node, std::vector<int>(evalBlockCells, literalBits(node)));
+        for (auto & arg : node.args) {
+            broadcastLiterals(*arg);
+        }
+    }
+
+    /**
+     * Evaluate node for the n cells from begin.
+     *
+     * @return the cells, in an input, a literal block or a scratch buffer
+     */
+    const int * eval(const Node & node, size_t begin, size_t n, Scratch & scratch,
+                     size_t slot) const {
+        using Kind = Node::Kind;
+        switch (node.kind) {
+            case Kind::Number:
+                return literals.at(&node).data();
+            case Kind::Table: {
+                auto it = std::find(names.begin(), names.end(), node.text);
+                return inputs[it - names.begin()]->data() + begin;
+            }
+            case Kind::Negate: {
+                auto arg = eval(*node.args[0], begin, n, scratch, slot + 1);
+                int * out = scratch.buffer(slot);
+                kernelFor(Op::Sub, format)(zeros.data(), arg, out, n);
+                return out;
+            }
+            case Kind::Binary: {
+                auto lhs = eval(*node.args[0], begin, n, scratch, slot + 1);
+                auto rhs = eval(*node.args[1], begin, n, scratch, slot + 2);
+                int * out = scratch.buffer(slot);
+                kernelFor(binaryOp(node.op), format)(lhs, rhs, out, n);
+                return out;
+            }
+            case Kind::Call: {
+                auto arg = eval(*node.args[0], begin, n, scratch, slot + 1);
+                if (node.text == "abs") {
+                    if (format == Table::Format::R32UI)
+                        return arg;
+                    int * out = scratch.buffer(slot);
+                    kernelFor(Op::Sub, format)(zeros.data(), arg, out, n);
+                    kernelFor(Op::Max, format)(arg, out, out, n);
+                    return out;
+                }
+                auto other = eval(*node.args[1], begin, n, scratch, slot + 2);
+                int * out = scratch.buffer(slot);
+                kernelFor(node.text == "min" ? Op::Min : Op::Max, format)(arg, other, out, n);
+                return out;
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    /**
+     * @param inputs the tables of names, all the same size and format
+     * @param names the table names used by root
+     * @param root the expression, with no bitwise ops for float tables
+     */
+    Evaluator(const std::vector<Table::Ptr> & inputs,
+              const std::vector<std::string> & names,
+              const Node & root)
+        : inputs(inputs),
+          names(names),
+          root(root),
+          format(inputs[0]->getFormat()),
+          zeros(evalBlockCells, 0) {
+        broadcastLiterals(root);
+    }
+
+    /**
+     * Write the cells from begin to end of the expression to out, which
+     * holds every cell. Distinct ranges can be evaluated in parallel.
+     */
+    void evaluate(size_t begin, size_t end, int * out) const {
+        Scratch scratch;
+        for (size_t block = begin; block < end; block += evalBlockCells) {
+            size_t n = std::min(evalBlockCells, end - block);
+            std::copy_n(eval(root, block, n, scratch, 0), n, out + block);
+        }
+    }
+
+    static Op binaryOp(char op) {
+        switch (op) {
+            case '+':
+                return Op::Add;
+            case '-':
+                return Op::Sub;
+            case '*':
+                return Op::Mul;
+            case '/':
+                return Op::Div;
+            case '&':
+                return Op::And;
+            case '|':
+                return Op::Or;
+            case '^':
+            default:
+                return Op::Xor;
+        }
+    }
+};
+
+} // namespace
+
+Table::Ptr CPUBackend::evaluate(const Expression & expr,
+                                const std::vector<Table::Ptr> & tables) {
+    if (expr.getTables().empty()) {
+        fmt::print(stderr, "CPUBackend expression {} uses no tables\n", expr.normalized());
+        return nullptr;
+    }
+
+    auto inputs = bindTables(expr, tables);
+    if (inputs.empty())
+        return nullptr;
+
+    auto & first = inputs[0];
+    int width = first->getWidth();
+    int height = first->getHeight();
+    auto format = first->getFormat();
+    for (auto & input : inputs) {
+        if (input->getWidth() != width || input->getHeight() != height) {
+            fmt::print(stderr, "CPUBackend input size mismatch {}x{} != {}x{}\n",
+                       input->getWidth(), input->getHeight(), width, height);
+            return nullptr;
+        }
+        if (input->getFormat() != format) {
+            fmt::print(stderr, "CPUBackend input {} format does not match {}\n",
+                       input->getName(), first->getName());
+            return nullptr;
+        }
+    }
+
+    if (format == Table::Format::R32F && expr.usesBitwise()) {
+        fmt::print(stderr, "CPUBackend bitwise ops are not supported for float tables\n");
+        return nullptr;
+    }
+
+    // The output is written by the evaluator, so it never aliases an input
+    auto output = Table::uninitialized(expr.getOutput(), width, height, format);
+    Evaluator evaluator(inputs, expr.getTables(), *expr.getRoot());
+    int * out = output->data();
+
+    size_t cells = static_cast<size_t>(width) * height;
+    size_t workers = std::min<size_t>(threads, cells / minCellsPerThread);
+    if (workers <= 1) {
+        evaluator.evaluate(0, cells, out);
+        return output;
+    }
+
+    // Whole blocks per worker, the threads start once for the whole tree
+    std::vector<std::thread> pool;
+    size_t blocks = (cells + evalBlockCells - 1) / evalBlockCells;
+    size_t cellsPerWorker = (blocks + workers - 1) / workers * evalBlockCells;
+    for (size_t begin = 0; begin < cells; begin += cellsPerWorker) {
+        size_t end = std::min(begin + cellsPerWorker, cells);
+        pool.emplace_back([&evaluator, begin, end, out] { evaluator.evaluate(begin, end, out); });
+    }
+    for (auto & t : pool) {
+        t.join();
+    }
+
+    return output;
+}
+
+namespace {
+
+// Cell bits as the Scalar type of the format
+template <typename T>
+T cellValue(int bits) {
+    if constexpr (std::is_same_v<T, double>)
+        return asFloat(bits);
+    else if constexpr (std::is_same_v<T, uint64_t>)
+        return static_cast<uint32_t>(bits);
+    else
+        return bits;
+}
+
+// The accumulator before the first cell of a line
+template <typename T>
+T initial(Reduce reduce, int first) {
+    if (reduce == Reduce::Min || reduce == Reduce::Max)
+        return cellValue<T>(first);
+    return 0;
+}
+
+template <typename T>
+T accumulate(Reduce reduce, T acc, T value) {
+    switch (reduce) {
+        case Reduce::Count:
+            return acc + (value != 0);
+        case Reduce::Min:
+            return std::min(acc, value);
+        case Reduce::Max:
+            return std::max(acc, value);
+        default:
+            return acc + value;
+    }
+}
+
+// Merge two accumulators, counts add like sums
+template <typename T>
+T combine(Reduce reduce, T a, T b) {
+    return accumulate(reduce == Reduce::Count ? Reduce::Sum : reduce, a, b);
+}
+
+template <typename T>
+T reduceRange(Reduce reduce, const int * cells, size_t n) {
+    T acc = initial<T>(reduce, cells[0]);
+    for (size_t i = 0; i < n; i++) {
+        acc = accumulate(reduce, acc, cellValue<T>(cells[i]));
+    }
+    return acc;
+}
+
+template <typename T>
+T reduceCells(Reduce reduce, const int * cells, size_t n, unsigned threads) {
+    size_t workers = std::min<size_t>(threads, n / minCellsPerThread);
+    if (workers <= 1)
+        return reduceRange<T>(reduce, cells, n);
+
+    std::vector<T> partials(workers);
+    std::vector<std::thread> pool;
+    size_t perWorker = (n + workers - 1) / workers;
+    for (size_t w = 0; w < workers; w++) {
+        size_t begin = std::min(n, w * perWorker);
+        size_t end = std::min(n, begin + perWorker);
+        if (begin == end) {
+            partials.resize(w);
+            break;
+        }
+        pool.emplace_back([&, w, begin, end] {
+            partials[w] = reduceRange<T>(reduce, cells + begin, end - begin);
+        });
+    }
+    for (auto & t : pool) {
+        t.join();
+    }
+
+    T acc = partials[0];
+    for (size_t w = 1; w < partials.size(); w++) {
+        acc = combine(reduce, acc, partials[w]);
+    }
+    return acc;
+}
+
+template <typename T>
+Scalar reduceTable(Reduce reduce, const int * cells, size_t n, unsigned threads) {
+    T total = reduceCells<T>(reduce, cells, n, threads);
+    if (reduce == Reduce::Count)
+        return static_cast<uint64_t>(total);
+    if (reduce == Reduce::Mean)
+        return static_cast<double>(total) / n;
+    return total;
+}
+
+// Reduce the rows or columns begin to end of a width x height table into out
+template <typename T>
+void reduceLines(Reduce reduce, Axis axis, const int * cells, int width, int height,
+                 size_t begin, size_t end, T * out) {
+    if (axis == Axis::Rows) {
+        for (size_t row = begin; row < end; row++) {
+            out[row] = reduceRange<T>(reduce, cells + row * width, width);
+        }
+        return;
+    }
+
+    // Walk down the rows so reads stay contiguous
+    for (size_t col = begin; col < end; col++) {
+        out[col] = initial<T>(reduce, cells[col]);
+    }
+    for (int row = 0; row < height; row++) {
+        const int * line = cells + static_cast<size_t>(row) * width;
+        for (size_t col = begin; col < end; col++) {
+            out[col] = accumulate(reduce, out[col], cellValue<T>(line[col]));
+        }
+    }
+}
+
+template <typename T>
+Table::Ptr reduceAxis(Reduce reduce, Axis axis, const Table & table,
+                      const std::string_view & name, unsigned threads) {
+    int width = table.getWidth();
+    int height = table.getHeight();
+    size_t lines = axis == Axis::Rows ? height : width;
+    size_t lineLength = axis == Axis::Rows ? width : height;
+
+    std::vector<T> acc(lines);
+    size_t cells = static_cast<size_t>(width) * height;
+    size_t workers = std::min<size_t>(threads, cells / minCellsPerThread);
+    workers = std::min(workers, lines);
+
+    if (workers <= 1) {
+        reduceLines(reduce, axis, table.data(), width, height, 0, lines, acc.data());
+    }
+    else {
+        // Each worker owns whole lines so no partials need combining
+        std::vector<std::thread> pool;
+        size_t perWorker = (lines + workers - 1) / workers;
+        for (size_t begin = 0; begin < lines; begin += perWorker) {
+            size_t end = std::min(lines, begin + perWorker);
+            pool.emplace_back(reduceLines<T>, reduce, axis, table.data(), width, height,
+                              begin, end, acc.data());
+        }
+        for (auto & t : pool) {
+            t.join();
+        }
+    }
+
+    auto format = reduceOutputFormat(reduce, table.getFormat());
+    auto output = axis == Axis::Rows ? std::make_shared<Table>(name, 1, height, format)
+                                     : std::make_shared<Table>(name, width, 1, format);
+    for (size_t line = 0; line < lines; line++) {
+        int row = axis == Axis::Rows ? line : 0;
+        int col = axis == Axis::Rows ? 0 : line;
+        setReduced(*output, row, col, reduce, acc[line], lineLength);
+    }
+    return output;
+}
+
+} // namespace
+
+std::optional<Scalar> CPUBackend::reduce(Reduce reduce, const Table::Ptr & table) {
+    size_t cells = static_cast<size_t>(table->getWidth()) * table->getHeight();
+    if (cells == 0) {
+        fmt::print(stderr, "CPUBackend can not reduce empty table {}\n", table->getName());
+        return std::nullopt;
+    }
+
+    const int * data = table->data();
+    switch (table->getFormat()) {
+        case Table::Format::R32F:
+            return reduceTable<double>(reduce, data, cells, threads);
+        case Table::Format::R32UI:
+            return reduceTable<uint64_t>(reduce, data, cells, threads);
+        default:
+            return reduceTable<int64_t>(reduce, data, cells, threads);
+    }
+}
+
+Table::Ptr CPUBackend::reduce(Reduce reduce,
+                              Axis axis,
+                              const Table::Ptr & table,
+                              const std::string_view & name) {
+    if (table->getWidth() == 0 || table->getHeight() == 0) {
+        fmt::print(stderr, "CPUBackend can not reduce empty table {}\n", table->getName());
+        return nullptr;
+    }
+
+    switch (table->getFormat()) {
+        case Table::Format::R32F:
+            return reduceAxis<double>(reduce, axis, *table, name, threads);
+        case Table::Format::R32UI:
+            return reduceAxis<uint64_t>(reduce, axis, *table, name, threads);
+        default:
+            return reduceAxis<int64_t>(reduce, axis, *table, name, threads);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "backend.hpp"
+
+/**
+ * Backend that evaluates ops on the host with SIMD kernels, splitting the
+ * rows of each table across worker threads. No EGL context is required.
+ */
+class CPUBackend : public Backend {
+    unsigned threads;
+
+public:
+    /**
+     * Create a new CPUBackend.
+     *
+     * @param threads the number of worker threads, 0 to use one per core
+     */
+    CPUBackend(unsigned threads = 0);
+
+    Table::Ptr run(Op op,
+                   const Table::Ptr & one,
+                   const Table::Ptr & two,
+                   const std::string_view & name) override;
+
+    /**
+     * Fill the output with op(0, two), then compute the stored cells of one
+     * as a packed array with the same kernels as dense tables.
+     */
+    Table::Ptr run(Op op,
+                   const SparseTable::Ptr & one,
+                   const Table::Ptr & two,
+                   const std::string_view & name) override;
+
+    /**
+     * Gather the cells of two at the stored cells of one and compute only
+     * those, the pattern is shared with one.
+     */
+    SparseTable::Ptr runSparse(Op op,
+                               const SparseTable::Ptr & one,
+                               const Table::Ptr & two,
+                               const std::string_view & name) override;
+
+    /**
+     * Evaluate the whole tree for one block of cells at a time with the op
+     * kernels, literals broadcast into a block, so only the output table is
+     * allocated and the threads start once.
+     */
+    Table::Ptr evaluate(const Expression & expr,
+                        const std::vector<Table::Ptr> & tables) override;
+
+    std::optional<Scalar> reduce(Reduce reduce, const Table::Ptr & table) override;
+
+    Table::Ptr reduce(Reduce reduce,
+                      Axis axis,
+                      const Table::Ptr & table,
+                      const std::string_view & name) override;
+
+    using Backend::evaluate;
+};
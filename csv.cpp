@@ -0,0 +1,357 @@
+#include "csv.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "file_io.hpp"
+#include "sparse.hpp"
+
+namespace {
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char * skipBlank(const char * p, const char * end) {
+    while (p < end && isBlank(*p))
+        p++;
+    return p;
+}
+
+inline const char * lineEnd(const char * p, const char * end) {
+    auto nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    return nl ? nl : end;
+}
+
+// Count the values on one line, which is one more than the commas
+int countColumns(const char * p, const char * end) {
+    int cols = 1;
+    while ((p = static_cast<const char *>(std::memchr(p, ',', end - p)))) {
+        cols++;
+        p++;
+    }
+    return cols;
+}
+
+template <typename T>
+const char * parseValue(const char * p, const char * end, int & cell) {
+    if (p < end && *p == '+')
+        p++;
+
+    T val;
+    auto [ptr, ec] = std::from_chars(p, end, val);
+    if (ec != std::errc())
+        return nullptr;
+
+    std::memcpy(&cell, &val, sizeof(cell));
+    return ptr;
+}
+
+/**
+ * Parse width values from one line into out.
+ *
+ * @return nullptr on success or a description of the error
+ */
+template <typename T>
+const char * parseRow(const char * p, const char * end, int width, int * out) {
+    for (int c = 0; c < width; c++) {
+        p = skipBlank(p, end);
+        if (c > 0) {
+            if (p == end)
+                return "too few values";
+            if (*p != ',')
+                return "expected ','";
+            p = skipBlank(p + 1, end);
+        }
+
+        p = parseValue<T>(p, end, out[c]);
+        if (!p)
+            return "invalid value";
+    }
+
+    p = skipBlank(p, end);
+    if (p != end)
+        return *p == ',' ? "too many values" : "unexpected character";
+    return nullptr;
+}
+
+/**
+ * Parse every non blank line into rows.nextRow(), then call rows.endRow().
+ */
+template <typename T, typename Rows>
+bool parseRows(const MappedFile & file,
+               const std::string_view & filename,
+               int width,
+               Rows & rows) {
+    int lineNumber = 0;
+    for (const char * p = file.begin(); p < file.end();) {
+        const char * end = lineEnd(p, file.end());
+        lineNumber++;
+
+        if (skipBlank(p, end) != end) {
+            auto error = parseRow<T>(p, end, width, rows.nextRow());
+            if (error) {
+                fmt::print(stderr, "{}:{}: malformed row, {}\n", filename, lineNumber, error);
+                return false;
+            }
+            rows.endRow();
+        }
+
+        p = end + 1;
+    }
+    return true;
+}
+
+template <typename Rows>
+bool parseRows(const MappedFile & file,
+               const std::string_view & filename,
+               Table::Format format,
+               int width,
+               Rows & rows) {
+    switch (format) {
+        case Table::Format::R32UI:
+            return parseRows<unsigned>(file, filename, width, rows);
+        case Table::Format::R32F:
+            return parseRows<float>(file, filename, width, rows);
+        default:
+            return parseRows<int>(file, filename, width, rows);
+    }
+}
+
+/**
+ * Rows parsed straight into the cells of a table.
+ */
+class DenseRows {
+    int * out;
+    int width;
+
+public:
+    DenseRows(Table & table) : out(table.data()), width(table.getWidth()) {}
+
+    int * nextRow() {
+        return out;
+    }
+
+    void endRow() {
+        out += width;
+    }
+};
+
+/**
+ * Size a table from the first row and the non blank lines.
+ *
+ * @return false if there are no rows, which is printed
+ */
+bool measure(const MappedFile & file, const std::string_view & filename, int & width, int & height) {
+    width = 0;
+    height = 0;
+    for (const char * p = file.begin(); p < file.end();) {
+        const char * end = lineEnd(p, file.end());
+        if (skipBlank(p, end) != end) {
+            if (height == 0)
+                width = countColumns(p, end);
+            height++;
+        }
+        p = end + 1;
+    }
+
+    if (height == 0) {
+        fmt::print(stderr, "{} has no rows\n", filename);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+Table::Ptr read_csv(const std::string_view & filename, Table::Format format) {
+    MappedFile file {std::string(filename)};
+    if (file.empty()) {
+        fmt::print(stderr, "{} could not be read or is empty\n", filename);
+        return nullptr;
+    }
+
+    // Size the table up front so rows are parsed in place
+    int width, height;
+    if (!measure(file, filename, width, height))
+        return nullptr;
+
+    auto tableName = tableNameOf(filename);
+    auto table = Table::uninitialized(tableName, width, height, format);
+
+    DenseRows rows(*table);
+    if (!parseRows(file, filename, format, width, rows))
+        return nullptr;
+
+    fmt::print(stderr, "Table {} loaded from {}\n", tableName, filename);
+    return table;
+}
+
+SparseTable::Ptr read_sparse_csv(const std::string_view & filename, Table::Format format) {
+    MappedFile file {std::string(filename)};
+    if (file.empty()) {
+        fmt::print(stderr, "{} could not be read or is empty\n", filename);
+        return nullptr;
+    }
+
+    int width, height;
+    if (!measure(file, filename, width, height))
+        return nullptr;
+
+    // Only one dense row is held at a time
+    SparseTable::Builder rows(width);
+    if (!parseRows(file, filename, format, width, rows))
+        return nullptr;
+
+    auto tableName = tableNameOf(filename);
+    fmt::print(stderr, "Sparse table {} loaded from {}\n", tableName, filename);
+    return rows.build(tableName, format);
+}
+
+namespace {
+
+/**
+ * Formats cells into a fixed buffer and writes it to fd in large chunks.
+ */
+class CSVWriter {
+    // Longest formatted cell plus separator, a float is at most 15 chars
+    static constexpr size_t maxCellChars = 32;
+
+    int fd;
+    std::vector<char> buffer;
+    size_t used = 0;
+    bool failed = false;
+
+public:
+    CSVWriter(int fd, size_t bufferSize) : fd(fd), buffer(bufferSize) {}
+
+    bool flush() {
+        if (!failed && !writeAll(fd, buffer.data(), used)) {
+            fmt::print(stderr, "write_csv failed: {}\n", std::strerror(errno));
+            failed = true;
+        }
+        used = 0;
+        return !failed;
+    }
+
+    void put(char c) {
+        buffer[used++] = c;
+    }
+
+    void put(const char * str, size_t n) {
+        std::memcpy(buffer.data() + used, str, n);
+        used += n;
+    }
+
+    template <typename T>
+    void putValue(T val) {
+        char * begin = buffer.data() + used;
+        auto res = std::to_chars(begin, buffer.data() + buffer.size(), val);
+        used += res.ptr - begin;
+    }
+
+    /// Make room for at least one more cell, flushing if needed
+    void reserveCell() {
+        if (buffer.size() - used < maxCellChars)
+            flush();
+    }
+};
+
+/**
+ * Write height rows of width cells, rowAt(r) gives the cells of row r.
+ */
+template <typename T, typename RowAt>
+bool writeRows(CSVWriter & writer, int width, int height, RowAt rowAt) {
+    for (int r = 0; r < height; r++) {
+        const int * cells = rowAt(r);
+        for (int c = 0; c < width; c++) {
+            writer.reserveCell();
+            if (c > 0)
+                writer.put(", ", 2);
+
+            T val;
+            std::memcpy(&val, cells++, sizeof(val));
+            writer.putValue(val);
+        }
+        writer.reserveCell();
+        writer.put('\n');
+    }
+    return writer.flush();
+}
+
+template <typename RowAt>
+bool writeRows(int fd,
+               size_t bufferSize,
+               Table::Format format,
+               int width,
+               int height,
+               RowAt rowAt) {
+    CSVWriter writer(fd, std::max(bufferSize, size_t(4096)));
+
+    switch (format) {
+        case Table::Format::R32UI:
+            return writeRows<unsigned>(writer, width, height, rowAt);
+        case Table::Format::R32F:
+            return writeRows<float>(writer, width, height, rowAt);
+        default:
+            return writeRows<int>(writer, width, height, rowAt);
+    }
+}
+
+template <typename TableType>
+bool writeFile(const std::string_view & filename, const TableType & table, size_t bufferSize) {
+    int fd = open(std::string(filename).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fmt::print(stderr, "{} could not be opened for writing: {}\n", filename,
+                   std::strerror(errno));
+        return false;
+    }
+
+    bool ok = write_csv(fd, table, bufferSize);
+    if (close(fd) != 0)
+        ok = false;
+    return ok;
+}
+
+} // namespace
+
+bool write_csv(int fd, const Table & table, size_t bufferSize) {
+    int width = table.getWidth();
+    return writeRows(fd, bufferSize, table.getFormat(), width, table.getHeight(),
+                     [&](int r) { return table.data() + static_cast<size_t>(r) * width; });
+}
+
+bool write_csv(const std::string_view & filename, const Table & table, size_t bufferSize) {
+    return writeFile(filename, table, bufferSize);
+}
+
+bool write_csv(int fd, const SparseTable & table, size_t bufferSize) {
+    auto & rowStart = table.getRowStart();
+    auto & columns = table.getColumns();
+    auto & values = table.getValues();
+
+    // Expand one row at a time, clearing only the cells the last row set
+    std::vector<int> row(table.getWidth());
+    return writeRows(fd, bufferSize, table.getFormat(), table.getWidth(), table.getHeight(),
+                     [&](int r) {
+                         for (size_t i = r > 0 ? rowStart[r - 1] : 0; i < rowStart[r]; i++) {
+                             row[columns[i]] = 0;
+                         }
+                         for (size_t i = rowStart[r]; i < rowStart[r + 1]; i++) {
+                             row[columns[i]] = values[i];
+                         }
+                         return row.data();
+                     });
+}
+
+bool write_csv(const std::string_view & filename, const SparseTable & table, size_t bufferSize) {
+    return writeFile(filename, table, bufferSize);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+#include "sparse.hpp"
+#include "table.hpp"
+
+/**
+ * Load a table from a comma separated file.
+ *
+ * The file is memory mapped and parsed in place. Every non blank line is a
+ * row and must have the same number of values as the first. The table is
+ * named after the file name without directory or extension.
+ *
+ * @param filename the path to the csv file
+ * @param format the format of the table, which selects int, unsigned or
+ *               float parsing
+ *
+ * @return the table or nullptr if the file could not be read or is malformed
+ */
+Table::Ptr read_csv(const std::string_view & filename, Table::Format format);
+
+/**
+ * Load a table from a comma separated file into a SparseTable, see
+ * read_csv. Each row is parsed into a buffer and only its non zero cells are
+ * kept, so the dense table is never allocated.
+ *
+ * @param filename the path to the csv file
+ * @param format the format of the table
+ *
+ * @return the table or nullptr if the file could not be read or is malformed
+ */
+SparseTable::Ptr read_sparse_csv(const std::string_view & filename, Table::Format format);
+
+/**
+ * Write table as comma separated values to an open file descriptor, eg.
+ * STDOUT_FILENO or a pipe. Cells are formatted with std::to_chars into a
+ * reusable buffer that is written whenever it fills. fd is not closed.
+ *
+ * @param fd the file descriptor to write to
+ * @param table the table to write
+ * @param bufferSize the size of the output buffer in bytes
+ *
+ * @return was every byte written
+ */
+bool write_csv(int fd, const Table & table, size_t bufferSize = 1 << 20);
+
+/**
+ * Write table as comma separated values to the file filename, replacing it.
+ *
+ * @param filename the path to the csv file
+ * @param table the table to write
+ * @param bufferSize the size of the output buffer in bytes
+ *
+ * @return was the file written
+ */
+bool write_csv(const std::string_view & filename,
+               const Table & table,
+               size_t bufferSize = 1 << 20);
+
+/**
+ * Write every cell of a sparse table, zeros included, as comma separated
+ * values to an open file descriptor, see write_csv for tables. One row is
+ * expanded at a time.
+ *
+ * @param fd the file descriptor to write to
+ * @param table the table to write
+ * @param bufferSize the size of the output buffer in bytes
+ *
+ * @return was every byte written
+ */
+bool write_csv(int fd, const SparseTable & table, size_t bufferSize = 1 << 20);
+
+/**
+ * Write every cell of a sparse table as comma separated values to the file
+ * filename, replacing it.
+ *
+ * @param filename the path to the csv file
+ * @param table the table to write
+ * @param bufferSize the size of the output buffer in bytes
+ *
+ * @return was the file written
+ */
+bool write_csv(const std::string_view & filename,
+               const SparseTable & table,
+               size_t bufferSize = 1 << 20);
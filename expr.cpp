@@ -0,0 +1,648 @@
+#include "expr.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+
+namespace {
+
+using Node = Expression::Node;
+using NodePtr = std::shared_ptr<const Node>;
+
+// Functions of the expressions, which tables may not be named after. The
+// generated shaders only use prefixed identifiers for tables, so anything
+// else is free.
+const std::string_view reservedNames[] = {
+    "min",
+    "max",
+    "abs",
+};
+
+/**
+ * Recursive descent parser, one level per precedence:
+ *
+ *     assign  := [name '='] or
+ *     or      := xor ('|' xor)*
+ *     xor     := and ('^' and)*
+ *     and     := sum ('&' sum)*
+ *     sum     := product (('+' | '-') product)*
+ *     product := unary (('*' | '/') unary)*
+ *     unary   := '-' unary | primary
+ *     primary := number | name | name '(' or (',' or)* ')' | '(' or ')'
+ */
+class Parser {
+    std::string_view source;
+    size_t pos = 0;
+    std::string error;
+
+public:
+    explicit Parser(const std::string_view & source) : source(source) {}
+
+    Expression::Ptr parse() {
+        std::string output = "output";
+
+        // Look ahead for "name =" before parsing the expression itself
+        size_t start = pos;
+        auto name = parseName();
+        skipSpace();
+        if (!name.empty() && peek() == '=') {
+            if (isReserved(name)) {
+                pos = start;
+                fail("'{}' is reserved and can not name a table", name);
+            }
+            output = std::string(name);
+            pos++;
+        }
+        else {
+            pos = start;
+        }
+
+        auto root = error.empty() ? parseBinary(0) : nullptr;
+        if (root) {
+            skipSpace();
+            if (pos != source.size())
+                fail("unexpected '{}'", source[pos]);
+        }
+
+        if (!error.empty()) {
+            fmt::print(stderr, "expression:{}: {}\n", pos + 1, error);
+            fmt::print(stderr, "  {}\n  {:>{}}\n", source, '^', pos + 1);
+            return nullptr;
+        }
+
+        return std::make_shared<Expression>(output, root);
+    }
+
+private:
+    template <typename... Args>
+    NodePtr fail(const char * format, Args &&... args) {
+        if (error.empty())
+            error = fmt::format(format, std::forward<Args>(args)...);
+        return nullptr;
+    }
+
+    void skipSpace() {
+        while (pos < source.size() && std::isspace(static_cast<unsigned char>(source[pos])))
+            pos++;
+    }
+
+    char peek() const {
+        return pos < source.size() ? source[pos] : '\0';
+    }
+
+    static bool isReserved(const std::string_view & name) {
+        // Prefixed, a leading or double underscore would give the double
+        // underscore GLSL reserves
+        return name[0] == '_' || name.find("__") != std::string_view::npos
+               || std::find(std::begin(reservedNames), std::end(reservedNames), name)
+                      != std::end(reservedNames);
+    }
+
+    std::string_view parseName() {
+        skipSpace();
+        size_t start = pos;
+        if (pos < source.size()
+            && (std::isalpha(static_cast<unsigned char>(source[pos])) || source[pos] == '_')) {
+            while (pos < source.size()
+                   && (std::isalnum(static_cast<unsigned char>(source[pos]))
+                       || source[pos] == '_'))
+                pos++;
+        }
+        return source.substr(start, pos - start);
+    }
+
+    static int precedence(char op) {
+        switch (op) {
+            case '|':
+                return 1;
+            case '^':
+                return 2;
+            case '&':
+                return 3;
+            case '+':
+            case '-':
+                return 4;
+            case '*':
+            case '/':
+                return 5;
+            default:
+                return 0;
+        }
+    }
+
+    // Parse operators binding tighter than minPrecedence, left associative
+    NodePtr parseBinary(int minPrecedence) {
+        auto lhs = parseUnary();
+        while (lhs) {
+            skipSpace();
+            char op = peek();
+            int prec = precedence(op);
+            if (prec == 0 || prec <= minPrecedence)
+                break;
+            pos++;
+
+            auto rhs = parseBinary(prec);
+            if (!rhs)
+                return nullptr;
+
+            auto node = std::make_shared<Node>();
+            node->kind = Node::Kind::Binary;
+            node->op = op;
+            node->args = {lhs, rhs};
+            lhs = node;
+        }
+        return lhs;
+    }
+
+    NodePtr parseUnary() {
+        skipSpace();
+        if (peek() == '-') {
+            pos++;
+            auto arg = parseUnary();
+            if (!arg)
+                return nullptr;
+            auto node = std::make_shared<Node>();
+            node->kind = Node::Kind::Negate;
+            node->args = {arg};
+            return node;
+        }
+        return parsePrimary();
+    }
+
+    NodePtr parsePrimary() {
+        skipSpace();
+        char c = peek();
+
+        if (c == '(') {
+            pos++;
+            auto node = parseBinary(0);
+            if (!node)
+                return nullptr;
+            skipSpace();
+            if (peek() != ')')
+                return fail("expected ')'");
+            pos++;
+            return node;
+        }
+
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+            return parseNumber();
+
+        auto name = parseName();
+        if (name.empty())
+            return c ? fail("unexpected '{}'", c) : fail("unexpected end of expression");
+
+        skipSpace();
+        if (peek() == '(')
+            return parseCall(name);
+
+        if (isReserved(name))
+            return fail("'{}' is reserved and can not name a table", name);
+
+        auto node = std::make_shared<Node>();
+        node->kind = Node::Kind::Table;
+        node->text = std::string(name);
+        return node;
+    }
+
+    NodePtr parseCall(const std::string_view & name) {
+        size_t arity;
+        if (name == "min" || name == "max")
+            arity = 2;
+        else if (name == "abs")
+            arity = 1;
+        else
+            return fail("unknown function '{}'", name);
+
+        pos++;
+        auto node = std::make_shared<Node>();
+        node->kind = Node::Kind::Call;
+        node->text = std::string(name);
+        for (;;) {
+            auto arg = parseBinary(0);
+            if (!arg)
+                return nullptr;
+            node->args.push_back(arg);
+
+            skipSpace();
+            if (peek() == ',') {
+                pos++;
+                continue;
+            }
+            if (peek() == ')') {
+                pos++;
+                break;
+            }
+            return fail("expected ',' or ')'");
+        }
+
+        if (node->args.size() != arity)
+            return fail("{} takes {} arguments, got {}", name, arity, node->args.size());
+        return node;
+    }
+
+    NodePtr parseNumber() {
+        size_t start = pos;
+        while (pos < source.size()
+               && (std::isalnum(static_cast<unsigned char>(source[pos])) || source[pos] == '.'
+                   || ((source[pos] == '+' || source[pos] == '-')
+                       && (source[pos - 1] == 'e' || source[pos - 1] == 'E'))))
+            pos++;
+        auto text = source.substr(start, pos - start);
+        auto end = text.data() + text.size();
+
+        auto node = std::make_shared<Node>();
+        node->kind = Node::Kind::Number;
+
+        // Integers up to the 32 bit unsigned range keep their exact value,
+        // anything else is normalized through double
+        uint64_t integer;
+        auto intRes = std::from_chars(text.data(), end, integer);
+        if (intRes.ptr == end && intRes.ec != std::errc::invalid_argument) {
+            if (intRes.ec == std::errc::result_out_of_range || integer > UINT32_MAX)
+                return fail("integer {} does not fit in 32 bits", text);
+            node->text = std::to_string(integer);
+            node->value = static_cast<double>(integer);
+            return node;
+        }
+
+        double value;
+        auto floatRes = std::from_chars(text.data(), end, value);
+        if (floatRes.ec == std::errc::result_out_of_range
+            || (floatRes.ec == std::errc() && floatRes.ptr == end && std::abs(value) > FLT_MAX))
+            return fail("number {} is out of the float range", text);
+        if (floatRes.ec != std::errc() || floatRes.ptr != end) {
+            pos = start;
+            return fail("invalid number '{}'", text);
+        }
+        node->value = value;
+
+        char buff[32];
+        auto res = std::to_chars(buff, buff + sizeof(buff), value);
+        node->text = std::string(buff, res.ptr);
+        // Keep a decimal point so GLSL reads it as a float
+        if (node->text.find_first_of(".en") == std::string::npos)
+            node->text += ".0";
+        return node;
+    }
+};
+
+void collectTables(const Node & node, std::vector<std::string> & tables) {
+    if (node.kind == Node::Kind::Table
+        && std::find(tables.begin(), tables.end(), node.text) == tables.end())
+        tables.push_back(node.text);
+    for (auto & arg : node.args) {
+        collectTables(*arg, tables);
+    }
+}
+
+std::string normalize(const Node & node) {
+    switch (node.kind) {
+        case Node::Kind::Number:
+        case Node::Kind::Table:
+            return node.text;
+        case Node::Kind::Negate:
+            return fmt::format("(-{})", normalize(*node.args[0]));
+        case Node::Kind::Binary:
+            return fmt::format("({}{}{})", normalize(*node.args[0]), node.op,
+                               normalize(*node.args[1]));
+        case Node::Kind::Call: {
+            std::string res = node.text + "(";
+            for (size_t i = 0; i < node.args.size(); i++) {
+                if (i > 0)
+                    res += ',';
+                res += normalize(*node.args[i]);
+            }
+            return res + ")";
+        }
+    }
+    return "";
+}
+
+bool anyNode(const Node & node, const std::function<bool(const Node &)> & pred) {
+    if (pred(node))
+        return true;
+    for (auto & arg : node.args) {
+        if (anyNode(*arg, pred))
+            return true;
+    }
+    return false;
+}
+
+std::string glslOf(const Node & node, Table::Format format) {
+    switch (node.kind) {
+        case Node::Kind::Number: {
+            // Literals above INT_MAX need the u suffix to be valid GLSL
+            bool isInteger = node.text.find_first_of(".en") == std::string::npos;
+            if (isInteger && node.value > INT32_MAX)
+                return fmt::format("CELL({}u)", node.text);
+            return fmt::format("CELL({})", node.text);
+        }
+        case Node::Kind::Table:
+            return "cell_" + node.text;
+        case Node::Kind::Negate:
+            return fmt::format("(-{})", glslOf(*node.args[0], format));
+        case Node::Kind::Binary:
+            if (node.op == '/')
+                return fmt::format("cellDiv({}, {})", glslOf(*node.args[0], format),
+                                   glslOf(*node.args[1], format));
+            return fmt::format("({} {} {})", glslOf(*node.args[0], format), node.op,
+                               glslOf(*node.args[1], format));
+        case Node::Kind::Call: {
+            std::string res = node.text == "abs" ? "cellAbs(" : node.text + "(";
+            for (size_t i = 0; i < node.args.size(); i++) {
+                if (i > 0)
+                    res += ", ";
+                res += glslOf(*node.args[i], format);
+            }
+            return res + ")";
+        }
+    }
+    return "";
+}
+
+/**
+ * The GLSL helpers used by glslOf.
+ */
+std::string cellFunctions(Table::Format format) {
+    std::string source = R"(
+CELL cellDiv(CELL a, CELL b) {
+    if (b == CELL(0))
+        return CELL(0);
+    return a / b;
+}
+)";
+
+    if (format == Table::Format::R32UI)
+        source += "\nCELL cellAbs(CELL a) {\n    return a;\n}\n";
+    else
+        source += "\nCELL cellAbs(CELL a) {\n    return abs(a);\n}\n";
+    return source;
+}
+
+/**
+ * The body of calc after the tables are loaded into cell_ locals: the
+ * steps in order and the return of the last.
+ */
+std::string calcBody(const std::vector<const Expression *> & steps,
+                     const std::vector<std::string> & tables,
+                     Table::Format format) {
+    std::string source;
+
+    // Every step but the last becomes a local, a step output shadowing a
+    // table or earlier step reuses its local
+    std::vector<std::string_view> locals(tables.begin(), tables.end());
+    for (size_t i = 0; i + 1 < steps.size(); i++) {
+        auto & name = steps[i]->getOutput();
+        auto value = glslOf(*steps[i]->getRoot(), format);
+        if (std::find(locals.begin(), locals.end(), name) != locals.end()) {
+            source += fmt::format("    cell_{} = {};\n", name, value);
+        }
+        else {
+            source += fmt::format("    CELL cell_{} = {};\n", name, value);
+            locals.push_back(name);
+        }
+    }
+    source += fmt::format("    return {};\n}}\n", glslOf(*steps.back()->getRoot(), format));
+    return source;
+}
+
+} // namespace
+
+Expression::Expression(const std::string_view & output, std::shared_ptr<const Node> root)
+    : output(output), root(std::move(root)) {
+    collectTables(*this->root, tables);
+    normal = normalize(*this->root);
+}
+
+const std::string & Expression::getOutput() const {
+    return output;
+}
+
+const std::shared_ptr<const Expression::Node> & Expression::getRoot() const {
+    return root;
+}
+
+const std::vector<std::string> & Expression::getTables() const {
+    return tables;
+}
+
+const std::string & Expression::normalized() const {
+    return normal;
+}
+
+bool Expression::usesBitwise() const {
+    return anyNode(*root, [](const Node & node) {
+        return node.kind == Node::Kind::Binary
+               && (node.op == '&' || node.op == '|' || node.op == '^');
+    });
+}
+
+std::string Expression::fragmentSource(Table::Format format) const {
+    return fragmentSource({this}, tables, format);
+}
+
+std::string Expression::fragmentSource(const std::vector<const Expression *> & steps,
+                                       const std::vector<std::string> & tables,
+                                       Table::Format format) {
+    const char * cell;
+    const char * sampler;
+    switch (format) {
+        case Table::Format::R32UI:
+            cell = "uint";
+            sampler = "usampler2D";
+            break;
+        case Table::Format::R32F:
+            cell = "float";
+            sampler = "sampler2D";
+            break;
+        default:
+            cell = "int";
+            sampler = "isampler2D";
+            break;
+    }
+
+    bool packed = format == Table::Format::RGBA8;
+    if (packed)
+        sampler = "sampler2D";
+
+    std::string source = fmt::format("#version 330 core\n"
+                                     "#define CELL {}\n"
+                                     "\n"
+                                     "out {} FragColor;\n"
+                                     "\n"
+                                     "uniform int width;\n"
+                                     "uniform int height;\n"
+                                     "\n",
+                                     cell, packed ? "vec4" : "CELL");
+
+    for (auto & table : tables) {
+        source += fmt::format("uniform {} {};\n", sampler, samplerName(table));
+    }
+
+    if (packed) {
+        // Same packing as shader.frag
+        source += R"(
+int color_to_int(vec4 c) {
+    int res = 0;
+    for (int i = 0; i < 4; i++) {
+        res = res << 8;
+        res = res | (int(c[3-i] * 255.) & 255);
+    }
+    return res;
+}
+
+float part_of(int x, int off) {
+    return float((x >> off) & 255) / 255.;
+}
+
+vec4 int_to_color(int x) {
+    return vec4(part_of(x, 0), part_of(x, 8), part_of(x, 16), part_of(x, 24));
+}
+
+CELL getCell(sampler2D t, int x, int y) {
+    return color_to_int(texelFetch(t, ivec2(x, y), 0));
+}
+)";
+    }
+    else {
+        source += fmt::format(R"(
+CELL getCell({} t, int x, int y) {{
+    return texelFetch(t, ivec2(x, y), 0).r;
+}}
+)",
+                              sampler);
+    }
+
+    source += cellFunctions(format);
+
+    source += "\nCELL calc(int x, int y) {\n";
+    for (auto & table : tables) {
+        source += fmt::format("    CELL cell_{} = getCell({}, x, y);\n", table, samplerName(table));
+    }
+    source += calcBody(steps, tables, format);
+
+    source += fmt::format(R"(
+void main() {{
+    int x = int(gl_FragCoord.x);
+    int y = int(gl_FragCoord.y);
+    FragColor = {};
+}}
+)",
+                          packed ? "int_to_color(calc(x, y))" : "calc(x, y)");
+
+    return source;
+}
+
+std::string Expression::samplerName(const std::string_view & table) {
+    return fmt::format("t_{}", table);
+}
+
+std::string Expression::computeSource(Table::Format format) const {
+    return computeSource({this}, tables, format);
+}
+
+std::string Expression::computeSource(const std::vector<const Expression *> & steps,
+                                      const std::vector<std::string> & tables,
+                                      Table::Format format) {
+    // Cells are stored as they are on the host, so RGBA8 is plain int
+    const char * cell = "int";
+    if (format == Table::Format::R32UI)
+        cell = "uint";
+    else if (format == Table::Format::R32F)
+        cell = "float";
+
+    std::string source = fmt::format("#version 430 core\n"
+                                     "#define CELL {}\n"
+                                     "\n"
+                                     "layout(local_size_x = {}) in;\n"
+                                     "\n"
+                                     "uniform uint count;\n"
+                                     "\n",
+                                     cell, computeGroupSize);
+
+    for (size_t i = 0; i < tables.size(); i++) {
+        source += fmt::format("layout(std430, binding = {0}) readonly buffer Table_{1} {{\n"
+                              "    CELL cells_{1}[];\n"
+                              "}};\n",
+                              i, tables[i]);
+    }
+    source += fmt::format("layout(std430, binding = {}) writeonly buffer Output {{\n"
+                          "    CELL result_cells[];\n"
+                          "}};\n",
+                          tables.size());
+
+    source += cellFunctions(format);
+
+    source += "\nCELL calc(uint i) {\n";
+    for (auto & table : tables) {
+        source += fmt::format("    CELL cell_{0} = cells_{0}[i];\n", table);
+    }
+    source += calcBody(steps, tables, format);
+
+    // Groups are spread over y when x would exceed the dispatch limit
+    source += R"(
+void main() {
+    uint i = gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x
+             + gl_GlobalInvocationID.x;
+    if (i < count)
+        result_cells[i] = calc(i);
+}
+)";
+
+    return source;
+}
+
+std::string Expression::vertexSource(Table::Format format) const {
+    return vertexSource({this}, tables, format);
+}
+
+std::string Expression::vertexSource(const std::vector<const Expression *> & steps,
+                                     const std::vector<std::string> & tables,
+                                     Table::Format format) {
+    // Attributes hold the cells as they are on the host, so RGBA8 is plain int
+    const char * cell = "int";
+    if (format == Table::Format::R32UI)
+        cell = "uint";
+    else if (format == Table::Format::R32F)
+        cell = "float";
+
+    std::string source = fmt::format("#version 330 core\n"
+                                     "#define CELL {}\n"
+                                     "\n",
+                                     cell);
+
+    for (size_t i = 0; i < tables.size(); i++) {
+        source += fmt::format("layout(location = {}) in CELL attr_{};\n", i, tables[i]);
+    }
+    // Integer outputs must be flat, the value is captured before any
+    // interpolation anyway
+    source += fmt::format("\nflat out CELL {};\n", vertexOutput);
+
+    source += cellFunctions(format);
+
+    source += "\nCELL calc() {\n";
+    for (auto & table : tables) {
+        source += fmt::format("    CELL cell_{0} = attr_{0};\n", table);
+    }
+    source += calcBody(steps, tables, format);
+
+    source += fmt::format(R"(
+void main() {{
+    {} = calc();
+}}
+)",
+                          vertexOutput);
+
+    return source;
+}
+
+Expression::Ptr Expression::parse(const std::string_view & source) {
+    return Parser(source).parse();
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "table.hpp"
+
+/**
+ * A parsed element wise expression over named tables, eg.
+ *
+ *     out = (one + two) * 3 - min(one, two)
+ *
+ * Supported are number literals, table names, unary -, the binary operators
+ * + - * / & | ^ with C precedence, parentheses and the functions min(a, b),
+ * max(a, b) and abs(a). The optional "name =" prefix names the output table,
+ * which defaults to output.
+ */
+class Expression {
+public:
+    /**
+     * A node of the expression tree.
+     */
+    struct Node {
+        enum class Kind {
+            /// A literal, text holds the normalized number
+            Number,
+            /// A table reference, text holds the table name
+            Table,
+            /// Unary minus of args[0]
+            Negate,
+            /// args[0] op args[1]
+            Binary,
+            /// The function text applied to args
+            Call,
+        };
+
+        Kind kind;
+        std::string text;
+        /// The value of a Number, finite and within the float range
+        double value = 0;
+        char op = 0;
+        std::vector<std::shared_ptr<const Node>> args;
+    };
+
+    using Ptr = std::shared_ptr<Expression>;
+    using ConstPtr = std::shared_ptr<const Expression>;
+
+private:
+    std::string output;
+    std::shared_ptr<const Node> root;
+    std::vector<std::string> tables;
+    std::string normal;
+
+public:
+    Expression(const std::string_view & output, std::shared_ptr<const Node> root);
+
+    /**
+     * Get the output table name.
+     */
+    const std::string & getOutput() const;
+
+    /**
+     * Get the root of the expression tree.
+     */
+    const std::shared_ptr<const Node> & getRoot() const;
+
+    /**
+     * Get the names of the tables used, in order of first use.
+     */
+    const std::vector<std::string> & getTables() const;
+
+    /**
+     * Get the normalized expression, without the output name or whitespace
+     * and with every operation parenthesized. Equivalent sources give the
+     * same string so it can be used as a cache key.
+     */
+    const std::string & normalized() const;
+
+    /**
+     * Does the expression use & | or ^, which are not defined for floats.
+     */
+    bool usesBitwise() const;
+
+    /**
+     * Generate a fragment shader evaluating this expression for tables of
+     * format, modeled on native.frag and shader.frag. Each table is bound to
+     * the sampler uniform named by samplerName.
+     *
+     * @param format the format of the input and output tables
+     *
+     * @return the complete fragment shader source
+     */
+    std::string fragmentSource(Table::Format format) const;
+
+    /**
+     * Get the sampler uniform of table in the fragment shaders. Like every
+     * identifier generated for a table it is prefixed, so a table name can
+     * not clash with GLSL keywords or the rest of the shader.
+     */
+    static std::string samplerName(const std::string_view & table);
+
+    /**
+     * Generate one fragment shader evaluating steps in order, where each
+     * step may use the outputs of earlier steps by name. Intermediate values
+     * are locals of the shader so every input is read once and only the last
+     * step is written.
+     *
+     * @param steps the expressions in order, not empty
+     * @param tables the tables sampled, the names used before a step
+     *        produces them
+     * @param format the format of the input and output tables
+     *
+     * @return the complete fragment shader source
+     */
+    static std::string fragmentSource(const std::vector<const Expression *> & steps,
+                                      const std::vector<std::string> & tables,
+                                      Table::Format format);
+
+    /// Invocations per work group of the compute shaders
+    static constexpr int computeGroupSize = 256;
+
+    /**
+     * Generate a compute shader evaluating this expression over tables of
+     * format stored as shader storage buffers, see the static overload.
+     *
+     * @param format the format of the input and output tables
+     *
+     * @return the complete compute shader source
+     */
+    std::string computeSource(Table::Format format) const;
+
+    /**
+     * Generate one compute shader evaluating steps in order for every cell,
+     * like the fragment shader of fragmentSource. Table i is the storage
+     * buffer at binding i, the output the buffer after the tables. One
+     * invocation computes one cell, up to the uint uniform count.
+     *
+     * @param steps the expressions in order, not empty
+     * @param tables the tables read, the names used before a step produces
+     *        them
+     * @param format the format of the input and output tables
+     *
+     * @return the complete compute shader source
+     */
+    static std::string computeSource(const std::vector<const Expression *> & steps,
+                                     const std::vector<std::string> & tables,
+                                     Table::Format format);
+
+    /// The output variable of the vertex shaders, captured by transform feedback
+    static constexpr const char * vertexOutput = "result_cell";
+
+    /**
+     * Generate a vertex shader evaluating this expression for transform
+     * feedback, see the static overload.
+     *
+     * @param format the format of the input and output tables
+     *
+     * @return the complete vertex shader source
+     */
+    std::string vertexSource(Table::Format format) const;
+
+    /**
+     * Generate one vertex shader evaluating steps in order, like the
+     * fragment shader of fragmentSource, for one cell per vertex. Table i is
+     * the vertex attribute at location i and the last step is written to
+     * vertexOutput, to be captured with transform feedback.
+     *
+     * @param steps the expressions in order, not empty
+     * @param tables the tables read, the names used before a step produces
+     *        them
+     * @param format the format of the input and output tables
+     *
+     * @return the complete vertex shader source
+     */
+    static std::string vertexSource(const std::vector<const Expression *> & steps,
+                                    const std::vector<std::string> & tables,
+                                    Table::Format format);
+
+    /**
+     * Parse source into an Expression. Errors are printed with the column
+     * where parsing failed.
+     *
+     * @param source the expression source
+     *
+     * @return the expression or nullptr if source is not valid
+     */
+    static Expression::Ptr parse(const std::string_view & source);
+};
@@ -0,0 +1,225 @@
+#include "feedback_backend.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "pipeline.hpp"
+#include "trace.hpp"
+
+FeedbackBackend::FeedbackBackend(unsigned threads)
+    : context(1, 1), supported(false), maxAttributes(0), host(threads) {
+    context.makeCurrent();
+
+    // Without a context the version stays 0.0
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    supported = major >= 3;
+    if (!supported) {
+        fmt::print(stderr, "FeedbackBackend needs OpenGL 3.0, the context is {}.{}\n", major,
+                   minor);
+        return;
+    }
+
+    glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttributes);
+    vertices = std::make_shared<VBO>(std::vector<VertexAttribute>(), VBO::Mode::Points,
+                                     VBO::Usage::Stream);
+}
+
+Shader::Ptr FeedbackBackend::shaderFor(const std::string & key, const std::string & source) {
+    auto it = programs.find(key);
+    if (it != programs.end())
+        return it->second;
+
+    auto shader = Shader::fromFeedbackSource(source, {Expression::vertexOutput});
+    if (shader)
+        programs[key] = shader;
+    return shader;
+}
+
+bool FeedbackBackend::isSupported() const {
+    return supported;
+}
+
+bool FeedbackBackend::check(const std::vector<Table::Ptr> & inputs, bool bitwise) {
+    if (!supported) {
+        fmt::print(stderr, "FeedbackBackend transform feedback is not supported\n");
+        return false;
+    }
+
+    if (inputs.size() > static_cast<size_t>(maxAttributes)) {
+        fmt::print(stderr, "FeedbackBackend {} tables need more than the {} vertex attributes\n",
+                   inputs.size(), maxAttributes);
+        return false;
+    }
+
+    auto & first = inputs[0];
+    for (auto & input : inputs) {
+        if (input->getWidth() != first->getWidth() || input->getHeight() != first->getHeight()) {
+            fmt::print(stderr, "FeedbackBackend input size mismatch {}x{} != {}x{}\n",
+                       input->getWidth(), input->getHeight(), first->getWidth(),
+                       first->getHeight());
+            return false;
+        }
+        if (input->getFormat() != first->getFormat()) {
+            fmt::print(stderr, "FeedbackBackend input {} format does not match {}\n",
+                       input->getName(), first->getName());
+            return false;
+        }
+    }
+
+    if (bitwise && first->getFormat() == Table::Format::R32F) {
+        fmt::print(stderr, "FeedbackBackend bitwise ops are not supported for float tables\n");
+        return false;
+    }
+    return true;
+}
+
+Table::Ptr FeedbackBackend::capture(const Shader::Ptr & shader,
+                                    const std::vector<Table::Ptr> & inputs,
+                                    const std::string_view & name) {
+    auto & first = inputs[0];
+    auto format = first->getFormat();
+    size_t cells = static_cast<size_t>(first->getWidth()) * first->getHeight();
+    auto output = Table::uninitialized(name, first->getWidth(), first->getHeight(), format);
+    if (cells == 0)
+        return output;
+
+    size_t chunk = std::min(cells, chunkCells);
+    size_t chunkBytes = chunk * sizeof(int);
+
+    // Table i is attribute i, its cells follow the chunks of the tables
+    // before it in the one buffer
+    std::vector<VertexAttribute> layout;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (format == Table::Format::R32F)
+            layout.push_back({1, GL_FLOAT, 0, i * chunkBytes});
+        else if (format == Table::Format::R32UI)
+            layout.push_back({1, GL_UNSIGNED_INT, 0, i * chunkBytes, true});
+        else
+            layout.push_back({1, GL_INT, 0, i * chunkBytes, true});
+    }
+    vertices->setLayout(layout);
+
+    if (!captured || captured->getSize() < static_cast<GLsizeiptr>(chunkBytes))
+        captured = std::make_shared<FeedbackBuffer>(chunkBytes);
+    captured->bindBase(0);
+
+    shader->bind();
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    Table::Ptr result = output;
+    for (size_t offset = 0; offset < cells; offset += chunk) {
+        size_t n = std::min(chunk, cells - offset);
+        size_t bytes = n * sizeof(int);
+
+        vertices->loadFromData(nullptr, inputs.size() * chunkBytes, n);
+        for (size_t i = 0; i < inputs.size(); i++) {
+            TRACE_SCOPE("upload");
+            vertices->loadSubData(i * chunkBytes, inputs[i]->data() + offset, bytes);
+        }
+
+        glBeginTransformFeedback(GL_POINTS);
+        vertices->draw();
+        glEndTransformFeedback();
+
+        TRACE_SCOPE("readback");
+        auto mapped = captured->mapRead(bytes);
+        if (!mapped) {
+            fmt::print(stderr, "FeedbackBackend could not map the output of {}\n", name);
+            result = nullptr;
+            break;
+        }
+        std::memcpy(output->data() + offset, mapped, bytes);
+        captured->unmap();
+    }
+
+    glDisable(GL_RASTERIZER_DISCARD);
+    return result;
+}
+
+Table::Ptr FeedbackBackend::run(Op op,
+                                const Table::Ptr & one,
+                                const Table::Ptr & two,
+                                const std::string_view & name) {
+    bool bitwise = op == Op::And || op == Op::Or || op == Op::Xor;
+    if (!check({one, two}, bitwise))
+        return nullptr;
+
+    auto expr = Expression::parse(opExpression(op));
+    auto format = one->getFormat();
+    auto key = fmt::format("{}:{}", static_cast<int>(format), expr->normalized());
+    auto shader = shaderFor(key, expr->vertexSource(format));
+    if (!shader)
+        return nullptr;
+
+    return capture(shader, {one, two}, name);
+}
+
+Table::Ptr FeedbackBackend::evaluate(const Expression & expr,
+                                     const std::vector<Table::Ptr> & tables) {
+    if (expr.getTables().empty()) {
+        fmt::print(stderr, "FeedbackBackend expression {} uses no tables\n", expr.normalized());
+        return nullptr;
+    }
+
+    auto inputs = bindTables(expr, tables);
+    if (inputs.empty() || !check(inputs, expr.usesBitwise()))
+        return nullptr;
+
+    auto format = inputs[0]->getFormat();
+    auto key = fmt::format("{}:{}", static_cast<int>(format), expr.normalized());
+    auto shader = shaderFor(key, expr.vertexSource(format));
+    if (!shader)
+        return nullptr;
+
+    return capture(shader, inputs, expr.getOutput());
+}
+
+Table::Ptr FeedbackBackend::evaluate(const Pipeline & pipeline,
+                                     const std::vector<Table::Ptr> & tables) {
+    auto names = pipeline.getInputs();
+    if (names.empty()) {
+        fmt::print(stderr, "FeedbackBackend pipeline uses no tables\n");
+        return nullptr;
+    }
+
+    auto inputs = bindTables(names, tables);
+    if (inputs.empty() || !check(inputs, pipeline.usesBitwise()))
+        return nullptr;
+
+    auto format = inputs[0]->getFormat();
+    auto key = fmt::format("{}:{}", static_cast<int>(format), pipeline.normalized());
+    auto shader = shaderFor(key, pipeline.vertexSource(format));
+    if (!shader)
+        return nullptr;
+
+    return capture(shader, inputs, pipeline.getOutput());
+}
+
+Table::Ptr FeedbackBackend::run(Op op,
+                                const SparseTable::Ptr & one,
+                                const Table::Ptr & two,
+                                const std::string_view & name) {
+    return host.run(op, one, two, name);
+}
+
+SparseTable::Ptr FeedbackBackend::runSparse(Op op,
+                                            const SparseTable::Ptr & one,
+                                            const Table::Ptr & two,
+                                            const std::string_view & name) {
+    return host.runSparse(op, one, two, name);
+}
+
+std::optional<Scalar> FeedbackBackend::reduce(Reduce reduce, const Table::Ptr & table) {
+    return host.reduce(reduce, table);
+}
+
+Table::Ptr FeedbackBackend::reduce(Reduce reduce,
+                                   Axis axis,
+                                   const Table::Ptr & table,
+                                   const std::string_view & name) {
+    return host.reduce(reduce, axis, table, name);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Shader.hpp"
+#include "backend.hpp"
+#include "context.hpp"
+#include "cpu_backend.hpp"
+#include "tfb.hpp"
+#include "vbo.hpp"
+
+/**
+ * Backend that evaluates ops in a vertex shader and captures the results
+ * with transform feedback, for drivers without compute shaders.
+ *
+ * Tables are flat arrays of width * height cells fed to the shader as
+ * vertex attributes, one point per cell, so like ComputeBackend there is no
+ * tiling, texture size limit or framebuffer readback: rasterization is
+ * discarded and the captured buffer is mapped back. Only transform feedback
+ * and integer attributes are needed, both part of OpenGL 3.0 and OpenGL ES
+ * 3.0. Expressions and fused pipelines are compiled to their own vertex
+ * shader. Reductions run on the host with a CPUBackend.
+ */
+class FeedbackBackend : public Backend {
+    Context context;
+    bool supported;
+    GLint maxAttributes;
+    std::unordered_map<std::string, Shader::Ptr> programs;
+    VBO::Ptr vertices;
+    FeedbackBuffer::Ptr captured;
+    CPUBackend host;
+
+    Shader::Ptr shaderFor(const std::string & key, const std::string & source);
+
+    bool check(const std::vector<Table::Ptr> & inputs, bool bitwise);
+
+    /**
+     * Draw one point per cell of inputs, attribute i reading inputs[i], and
+     * capture the output of shader.
+     */
+    Table::Ptr capture(const Shader::Ptr & shader,
+                       const std::vector<Table::Ptr> & inputs,
+                       const std::string_view & name);
+
+public:
+    /// Cells drawn per call, bounding the size of the buffers
+    static constexpr size_t chunkCells = 1 << 22;
+
+    /**
+     * Create the context and make it current.
+     *
+     * @param threads the number of threads of the host reductions, 0 to use
+     *        one per core
+     */
+    FeedbackBackend(unsigned threads = 0);
+
+    /**
+     * Does the context support transform feedback, the ops fail if not.
+     */
+    bool isSupported() const;
+
+    Table::Ptr run(Op op,
+                   const Table::Ptr & one,
+                   const Table::Ptr & two,
+                   const std::string_view & name) override;
+
+    /**
+     * Run on the host, the stored cells of one are not worth a dispatch.
+     */
+    Table::Ptr run(Op op,
+                   const SparseTable::Ptr & one,
+                   const Table::Ptr & two,
+                   const std::string_view & name) override;
+
+    SparseTable::Ptr runSparse(Op op,
+                               const SparseTable::Ptr & one,
+                               const Table::Ptr & two,
+                               const std::string_view & name) override;
+
+    Table::Ptr evaluate(const Expression & expr,
+                        const std::vector<Table::Ptr> & tables) override;
+
+    /**
+     * Draw the fused steps of pipeline once over every cell.
+     */
+    Table::Ptr evaluate(const Pipeline & pipeline,
+                        const std::vector<Table::Ptr> & tables) override;
+
+    std::optional<Scalar> reduce(Reduce reduce, const Table::Ptr & table) override;
+
+    Table::Ptr reduce(Reduce reduce,
+                      Axis axis,
+                      const Table::Ptr & table,
+                      const std::string_view & name) override;
+};
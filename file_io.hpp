@@ -0,0 +1,124 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * Read only memory map of a whole file, unmapped on destruction.
+ */
+class MappedFile {
+    const char * begin_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit MappedFile(const std::string & path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void * addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                begin_ = static_cast<const char *>(addr);
+                size_ = st.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        if (begin_)
+            munmap(const_cast<char *>(begin_), size_);
+    }
+
+    const char * data() const {
+        return begin_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    const char * begin() const {
+        return begin_;
+    }
+
+    const char * end() const {
+        return begin_ + size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+};
+
+/**
+ * Write all size bytes of data to fd, retrying short and interrupted writes.
+ *
+ * @return were all bytes written, errno is set if not
+ */
+inline bool writeAll(int fd, const char * data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/**
+ * Read exactly size bytes from fd into data, retrying short and interrupted
+ * reads.
+ *
+ * @return were all bytes read, false at end of file or on error
+ */
+inline bool readAll(int fd, char * data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::read(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (n == 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/**
+ * Get the name of a table loaded from path, the file name without directory
+ * or extension.
+ */
+inline std::string_view tableNameOf(std::string_view filename) {
+    auto slashPos = filename.rfind('/');
+    if (slashPos != std::string_view::npos) {
+        filename.remove_prefix(slashPos + 1);
+    }
+
+    auto dotPos = filename.find('.');
+    if (dotPos != std::string_view::npos) {
+        filename.remove_suffix(filename.size() - dotPos);
+    }
+
+    return filename;
+}
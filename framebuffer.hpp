@@ -0,0 +1,90 @@
+#pragma once
+
+#include <GLES3/gl3.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "gl_state.hpp"
+#include "table.hpp"
+
+/**
+ * Manages a single framebuffer object that renders into a Table texture.
+ */
+class Framebuffer {
+    GLuint fbo;
+    // One past the highest color attachment used
+    mutable int attachments = 1;
+
+public:
+    using Ptr = std::shared_ptr<Framebuffer>;
+
+    Framebuffer() {
+        glGenFramebuffers(1, &fbo);
+    }
+
+    ~Framebuffer() {
+        GLState::deleteFramebuffer(fbo);
+    }
+
+    GLuint getFBO() const {
+        return fbo;
+    }
+
+    /**
+     * Bind table as a color attachment. The table texture must already
+     * have storage, see Table::allocate.
+     *
+     * @param table the table to render into
+     * @param index the color attachment, fragment output location index
+     *        writes here once enabled with drawBuffers
+     *
+     * @return is the framebuffer complete
+     */
+    bool attach(const Table & table, int index = 0) const {
+        bind();
+        attachments = std::max(attachments, index + 1);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + index,
+                               GL_TEXTURE_2D, table.getTexId(), 0);
+        return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    /**
+     * Draw to the first count color attachments.
+     *
+     * @param count the number of fragment outputs
+     */
+    void drawBuffers(int count) const {
+        bind();
+        std::vector<GLenum> buffers;
+        for (int i = 0; i < count; i++) {
+            buffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+        }
+        glDrawBuffers(count, buffers.data());
+    }
+
+    /**
+     * Detach every color attachment but 0 and draw to attachment 0 only, as
+     * a new framebuffer does.
+     */
+    void reset() const {
+        bind();
+        for (int i = 1; i < attachments; i++) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, 0, 0);
+        }
+        attachments = 1;
+        drawBuffers(1);
+    }
+
+    void bind() const {
+        GLState::bindFramebuffer(fbo);
+    }
+
+    /**
+     * Unbind the framebuffer, returning to the context surface.
+     */
+    void unbind() const {
+        GLState::bindFramebuffer(0);
+    }
+};
@@ -0,0 +1,270 @@
+#include "gl_backend.hpp"
+
+#include <fmt/core.h>
+
+#include "reduce.hpp"
+#include "tile.hpp"
+
+static const char * nativeHeader(Table::Format format) {
+    switch (format) {
+        case Table::Format::R32I:
+            return "#version 330 core\n"
+                   "#define CELL int\n"
+                   "#define SAMPLER isampler2D\n"
+                   "#define CELL_INTEGER\n";
+        case Table::Format::R32UI:
+            return "#version 330 core\n"
+                   "#define CELL uint\n"
+                   "#define SAMPLER usampler2D\n"
+                   "#define CELL_INTEGER\n";
+        case Table::Format::R32F:
+            return "#version 330 core\n"
+                   "#define CELL float\n"
+                   "#define SAMPLER sampler2D\n";
+        default:
+            return nullptr;
+    }
+}
+
+static std::vector<std::string> samplerNames(const std::vector<std::string> & tables) {
+    std::vector<std::string> samplers;
+    for (auto & table : tables) {
+        samplers.push_back(Expression::samplerName(table));
+    }
+    return samplers;
+}
+
+static std::string reduceHeader(Reduce reduce, Table::Format format, bool first) {
+    std::string header = "#version 330 core\n";
+
+    auto readFormat = first ? format : reduceLevelFormat(reduce, format);
+    switch (readFormat) {
+        case Table::Format::RGBA8:
+            header += "#define CELL int\n"
+                      "#define SAMPLER sampler2D\n"
+                      "#define PACKED\n"
+                      "#define CELL_SIGNED\n";
+            break;
+        case Table::Format::R32I:
+            header += "#define CELL int\n"
+                      "#define SAMPLER isampler2D\n"
+                      "#define CELL_SIGNED\n";
+            break;
+        case Table::Format::R32UI:
+            header += "#define CELL uint\n"
+                      "#define SAMPLER usampler2D\n";
+            break;
+        case Table::Format::R32F:
+            header += "#define CELL float\n"
+                      "#define SAMPLER sampler2D\n";
+            break;
+    }
+
+    if (first)
+        header += "#define FIRST\n";
+    if (reducesToPair(reduce, format))
+        header += "#define PAIR\n";
+
+    switch (reduce) {
+        case Reduce::Count:
+            header += "#define COUNT\n";
+            break;
+        case Reduce::Min:
+            header += "#define MIN\n";
+            break;
+        case Reduce::Max:
+            header += "#define MAX\n";
+            break;
+        default:
+            break;
+    }
+
+    return header;
+}
+
+GLBackend::GLBackend(int width,
+                     int height,
+                     const std::string_view & shaderDir,
+                     size_t cacheBytes)
+    : context(width, height), shaderDir(shaderDir) {
+    context.makeCurrent();
+    cache = std::make_shared<RenderCache>(cacheBytes);
+}
+
+Shader::Ptr GLBackend::shaderFor(Table::Format format) {
+    auto it = shaders.find(format);
+    if (it != shaders.end())
+        return it->second;
+
+    Shader::Ptr shader;
+    if (format == Table::Format::RGBA8)
+        shader = Shader::fromFragmentPath(shaderDir + "/shader.frag");
+    else
+        shader = Shader::fromFragmentPath(shaderDir + "/native.frag",
+                                          nativeHeader(format));
+
+    if (shader)
+        shaders[format] = shader;
+    return shader;
+}
+
+Table::Ptr GLBackend::run(Op op,
+                          const Table::Ptr & one,
+                          const Table::Ptr & two,
+                          const std::string_view & name) {
+    auto format = one->getFormat();
+    if (format == Table::Format::R32F
+        && (op == Op::And || op == Op::Or || op == Op::Xor)) {
+        fmt::print(stderr, "GLBackend bitwise ops are not supported for float tables\n");
+        return nullptr;
+    }
+
+    auto shader = shaderFor(format);
+    if (!shader)
+        return nullptr;
+
+    shader->bind();
+    shader->setInt("op", static_cast<int>(op));
+
+    // shader.frag and native.frag sample the operands as one and two,
+    // whatever the tables are called
+    return renderTiled(context, *cache, shader, {one, two}, {"one", "two"}, name);
+}
+
+Shader::Ptr GLBackend::shaderFor(const Expression & expr, Table::Format format) {
+    auto key = fmt::format("{}:{}", static_cast<int>(format), expr.normalized());
+
+    auto it = programs.find(key);
+    if (it != programs.end())
+        return it->second;
+
+    auto shader = Shader::fromFragmentSource(expr.fragmentSource(format));
+    if (shader)
+        programs[key] = shader;
+    return shader;
+}
+
+Shader::Ptr GLBackend::shaderFor(const Pipeline & pipeline, Table::Format format) {
+    auto & steps = pipeline.getSteps();
+    if (steps.size() == 1)
+        return shaderFor(*steps[0], format);
+
+    auto key = fmt::format("{}:{}", static_cast<int>(format), pipeline.normalized());
+
+    auto it = programs.find(key);
+    if (it != programs.end())
+        return it->second;
+
+    auto shader = Shader::fromFragmentSource(pipeline.fragmentSource(format));
+    if (shader)
+        programs[key] = shader;
+    return shader;
+}
+
+Table::Ptr GLBackend::evaluate(const Expression & expr,
+                               const std::vector<Table::Ptr> & tables) {
+    if (expr.getTables().empty()) {
+        fmt::print(stderr, "GLBackend expression {} uses no tables\n", expr.normalized());
+        return nullptr;
+    }
+
+    auto inputs = bindTables(expr, tables);
+    if (inputs.empty())
+        return nullptr;
+
+    auto format = inputs[0]->getFormat();
+    if (format == Table::Format::R32F && expr.usesBitwise()) {
+        fmt::print(stderr, "GLBackend bitwise ops are not supported for float tables\n");
+        return nullptr;
+    }
+
+    auto shader = shaderFor(expr, format);
+    if (!shader)
+        return nullptr;
+
+    return renderTiled(context, *cache, shader, inputs, samplerNames(expr.getTables()),
+                       expr.getOutput());
+}
+
+Table::Ptr GLBackend::evaluate(const Pipeline & pipeline,
+                               const std::vector<Table::Ptr> & tables) {
+    auto names = pipeline.getInputs();
+    if (names.empty()) {
+        fmt::print(stderr, "GLBackend pipeline uses no tables\n");
+        return nullptr;
+    }
+
+    auto inputs = bindTables(names, tables);
+    if (inputs.empty())
+        return nullptr;
+
+    auto format = inputs[0]->getFormat();
+    if (format == Table::Format::R32F && pipeline.usesBitwise()) {
+        fmt::print(stderr, "GLBackend bitwise ops are not supported for float tables\n");
+        return nullptr;
+    }
+
+    // Fuse the steps into one draw unless the inputs need more samplers than
+    // the fragment stage has
+    GLint maxUnits = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxUnits);
+    if (inputs.size() <= static_cast<size_t>(maxUnits)) {
+        auto shader = shaderFor(pipeline, format);
+        if (!shader)
+            return nullptr;
+        return renderTiled(context, *cache, shader, inputs, samplerNames(names),
+                           pipeline.getOutput());
+    }
+
+    std::vector<Pass> passes;
+    for (auto & step : pipeline.getSteps()) {
+        auto shader = shaderFor(*step, format);
+        if (!shader)
+            return nullptr;
+
+        passes.push_back(
+            {shader, step->getTables(), step->getOutput(), samplerNames(step->getTables())});
+    }
+
+    return renderPasses(context, *cache, passes, inputs, names);
+}
+
+Shader::Ptr GLBackend::shaderFor(Reduce reduce, Table::Format format, bool first) {
+    // A mean is a sum divided on the host
+    if (reduce == Reduce::Mean)
+        reduce = Reduce::Sum;
+
+    auto key = std::make_tuple(reduce, format, first);
+
+    auto it = reducers.find(key);
+    if (it != reducers.end())
+        return it->second;
+
+    auto shader = Shader::fromFragmentPath(shaderDir + "/reduce.frag",
+                                           reduceHeader(reduce, format, first));
+    if (shader)
+        reducers[key] = shader;
+    return shader;
+}
+
+std::optional<Scalar> GLBackend::reduce(Reduce reduce, const Table::Ptr & table) {
+    auto format = table->getFormat();
+
+    auto first = shaderFor(reduce, format, true);
+    auto rest = shaderFor(reduce, format, false);
+    if (!first || !rest)
+        return std::nullopt;
+
+    return reduceTiled(context, *cache, reduce, first, rest, *table);
+}
+
+Table::Ptr GLBackend::reduce(Reduce reduce,
+                             Axis axis,
+                             const Table::Ptr & table,
+                             const std::string_view & name) {
+    auto shader = shaderFor(reduce, table->getFormat(), true);
+    if (!shader)
+        return nullptr;
+
+    return reduceAxisTiled(context, *cache, reduce, axis, shader, *table, name);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+
+#include "Shader.hpp"
+#include "backend.hpp"
+#include "context.hpp"
+#include "render_cache.hpp"
+
+/**
+ * Backend that draws the op shaders over the tables in an EGL context.
+ *
+ * RGBA8 tables use shader.frag, the native formats use native.frag. Shaders
+ * are compiled the first time a format is used. Expressions are compiled
+ * to their own shader, cached by format and normalized expression so a
+ * repeated expression is never compiled again. The steps of a pipeline are
+ * fused into a single shader and drawn once per tile. Reductions use
+ * reduce.frag, compiled per reduction and format. The quad, tile textures,
+ * framebuffers and pixel buffers are kept between calls, so one backend can
+ * run many jobs without creating them again.
+ */
+class GLBackend : public Backend {
+    Context context;
+    RenderCache::Ptr cache;
+    std::string shaderDir;
+    std::map<Table::Format, Shader::Ptr> shaders;
+    std::unordered_map<std::string, Shader::Ptr> programs;
+    std::map<std::tuple<Reduce, Table::Format, bool>, Shader::Ptr> reducers;
+
+    Shader::Ptr shaderFor(Table::Format format);
+
+    Shader::Ptr shaderFor(const Expression & expr, Table::Format format);
+
+    Shader::Ptr shaderFor(const Pipeline & pipeline, Table::Format format);
+
+    Shader::Ptr shaderFor(Reduce reduce, Table::Format format, bool first);
+
+public:
+    /**
+     * Create the context and make it current.
+     *
+     * @param width the surface width, the maximum tile width
+     * @param height the surface height, the maximum tile height
+     * @param shaderDir the directory containing shader.frag and native.frag
+     * @param cacheBytes the memory limit of the cached tile textures and
+     *        pixel buffers, see RenderCache
+     */
+    GLBackend(int width,
+              int height,
+              const std::string_view & shaderDir,
+              size_t cacheBytes = RenderCache::defaultMaxBytes);
+
+    Table::Ptr run(Op op,
+                   const Table::Ptr & one,
+                   const Table::Ptr & two,
+                   const std::string_view & name) override;
+
+    Table::Ptr evaluate(const Expression & expr,
+                        const std::vector<Table::Ptr> & tables) override;
+
+    std::optional<Scalar> reduce(Reduce reduce, const Table::Ptr & table) override;
+
+    Table::Ptr reduce(Reduce reduce,
+                      Axis axis,
+                      const Table::Ptr & table,
+                      const std::string_view & name) override;
+
+    /**
+     * Draw the fused steps of pipeline once per tile, so each input is read
+     * once and only the output is written. When the inputs need more
+     * samplers than the GPU has, every step is drawn as its own pass
+     * instead, the intermediate tables still never leave the GPU.
+     */
+    Table::Ptr evaluate(const Pipeline & pipeline,
+                        const std::vector<Table::Ptr> & tables) override;
+
+    using Backend::run;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <GLES3/gl3.h>
+
+#include <array>
+#include <vector>
+
+/**
+ * Cache of the bindings of one context: the program, the texture bound to
+ * each unit, the array buffer, vertex array, framebuffer and viewport. A
+ * bind of what is already bound costs no driver call.
+ *
+ * The bind functions use the state of the context current on the calling
+ * thread, see Context::makeCurrent, and call GL directly when there is none.
+ * The cache only holds while every change of the tracked state goes through
+ * here, including deleting bound objects, which GL unbinds.
+ */
+class GLState {
+    static inline thread_local GLState * current = nullptr;
+
+    GLuint program = 0;
+    GLuint activeUnit = 0;
+    std::vector<GLuint> textures;
+    GLuint arrayBuffer = 0;
+    GLuint vertexArray = 0;
+    GLuint framebuffer = 0;
+    // Unknown until set, the surface size of a new context
+    std::array<GLint, 4> viewportRect {-1, -1, -1, -1};
+
+    GLuint & texture(GLuint unit) {
+        if (unit >= textures.size())
+            textures.resize(unit + 1, 0);
+        return textures[unit];
+    }
+
+public:
+    /**
+     * Use state for GL calls on this thread, nullptr for none. Called by
+     * Context::makeCurrent.
+     */
+    static void makeCurrent(GLState * state) {
+        current = state;
+    }
+
+    static GLState * getCurrent() {
+        return current;
+    }
+
+    static void useProgram(GLuint program) {
+        if (current && current->program == program)
+            return;
+        glUseProgram(program);
+        if (current)
+            current->program = program;
+    }
+
+    /**
+     * Make unit the active texture unit.
+     */
+    static void activeTexture(GLuint unit) {
+        if (current && current->activeUnit == unit)
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        if (current)
+            current->activeUnit = unit;
+    }
+
+    /**
+     * Bind texture to GL_TEXTURE_2D of unit, which becomes the active unit.
+     */
+    static void bindTexture(GLuint unit, GLuint texture) {
+        activeTexture(unit);
+        if (current && current->texture(unit) == texture)
+            return;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (current)
+            current->texture(unit) = texture;
+    }
+
+    /**
+     * Bind texture to GL_TEXTURE_2D of the active unit, eg. to upload it.
+     */
+    static void bindTexture(GLuint texture) {
+        bindTexture(current ? current->activeUnit : 0, texture);
+    }
+
+    static void bindArrayBuffer(GLuint buffer) {
+        if (current && current->arrayBuffer == buffer)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (current)
+            current->arrayBuffer = buffer;
+    }
+
+    static void bindVertexArray(GLuint vertexArray) {
+        if (current && current->vertexArray == vertexArray)
+            return;
+        glBindVertexArray(vertexArray);
+        if (current)
+            current->vertexArray = vertexArray;
+    }
+
+    static void bindFramebuffer(GLuint framebuffer) {
+        if (current && current->framebuffer == framebuffer)
+            return;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        if (current)
+            current->framebuffer = framebuffer;
+    }
+
+    static void viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+        std::array<GLint, 4> rect {x, y, width, height};
+        if (current && current->viewportRect == rect)
+            return;
+        glViewport(x, y, width, height);
+        if (current)
+            current->viewportRect = rect;
+    }
+
+    /**
+     * Delete program, stop using it first if it is in use so a new program
+     * with the same name is not mistaken for it.
+     */
+    static void deleteProgram(GLuint program) {
+        if (current && current->program == program)
+            useProgram(0);
+        glDeleteProgram(program);
+    }
+
+    static void deleteTexture(GLuint texture) {
+        glDeleteTextures(1, &texture);
+        if (!current)
+            return;
+        for (auto & bound : current->textures) {
+            if (bound == texture)
+                bound = 0;
+        }
+    }
+
+    static void deleteBuffer(GLuint buffer) {
+        glDeleteBuffers(1, &buffer);
+        if (current && current->arrayBuffer == buffer)
+            current->arrayBuffer = 0;
+    }
+
+    static void deleteVertexArray(GLuint vertexArray) {
+        glDeleteVertexArrays(1, &vertexArray);
+        if (current && current->vertexArray == vertexArray)
+            current->vertexArray = 0;
+    }
+
+    static void deleteFramebuffer(GLuint framebuffer) {
+        glDeleteFramebuffers(1, &framebuffer);
+        if (current && current->framebuffer == framebuffer)
+            current->framebuffer = 0;
+    }
+};
@@ -0,0 +1,326 @@
+#include "job.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <variant>
+
+#include "csv.hpp"
+#include "file_io.hpp"
+#include "npy.hpp"
+#include "pipeline.hpp"
+#include "trace.hpp"
+
+static bool is_npy(const std::string_view & path) {
+    return path.size() >= 4 && path.substr(path.size() - 4) == ".npy";
+}
+
+static Table::Ptr read_table(const std::string_view & path, Table::Format format) {
+    if (is_npy(path))
+        return read_npy(path, format);
+    return read_csv(path, format);
+}
+
+static SparseTable::Ptr read_sparse_table(const std::string_view & path, Table::Format format) {
+    if (is_npy(path))
+        return read_sparse_npy(path, format);
+    return read_sparse_csv(path, format);
+}
+
+template <typename TableType>
+static bool write_table(const std::string_view & path, const TableType & table) {
+    if (path == "-")
+        return write_csv(STDOUT_FILENO, table);
+    if (is_npy(path))
+        return write_npy(path, table);
+    return write_csv(path, table);
+}
+
+static double defaultSparseDensity() {
+    if (auto density = std::getenv("EGL_MATH_SPARSE"))
+        return std::strtod(density, nullptr);
+    return 0;
+}
+
+static double & sparseDensity() {
+    static double density = defaultSparseDensity();
+    return density;
+}
+
+void setSparseDensity(double density) {
+    sparseDensity() = density;
+}
+
+double getSparseDensity() {
+    return sparseDensity();
+}
+
+static bool write_text(const std::string_view & path, const std::string & text) {
+    if (path == "-")
+        return writeAll(STDOUT_FILENO, text.data(), text.size());
+
+    int fd = open(std::string(path).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fmt::print(stderr, "Failed to open {} for writing\n", path);
+        return false;
+    }
+    bool ok = writeAll(fd, text.data(), text.size());
+    close(fd);
+    return ok;
+}
+
+static std::string_view trim(std::string_view text) {
+    auto start = text.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos)
+        return {};
+    auto end = text.find_last_not_of(" \t\r");
+    return text.substr(start, end - start + 1);
+}
+
+std::optional<Job> parseJob(const std::string_view & line, const std::string_view & where) {
+    auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        fmt::print(stderr, "{}: missing ':' before the op\n", where);
+        return std::nullopt;
+    }
+
+    Job job;
+    job.op = trim(line.substr(colon + 1));
+    if (job.op.empty()) {
+        fmt::print(stderr, "{}: missing op after ':'\n", where);
+        return std::nullopt;
+    }
+
+    auto paths = line.substr(0, colon);
+    size_t pos = 0;
+    while (true) {
+        pos = paths.find_first_not_of(" \t", pos);
+        if (pos == std::string_view::npos)
+            break;
+        size_t end = std::min(paths.find_first_of(" \t", pos), paths.size());
+        auto path = std::string(paths.substr(pos, end - pos));
+        if (job.output.empty())
+            job.output = path;
+        else
+            job.inputs.push_back(path);
+        pos = end;
+    }
+
+    if (job.inputs.empty()) {
+        fmt::print(stderr, "{}: expected an output path and at least one input path\n",
+                   where);
+        return std::nullopt;
+    }
+
+    return job;
+}
+
+std::optional<std::vector<Job>> readManifest(const std::string_view & filename) {
+    std::ifstream file {std::string(filename)};
+    if (!file) {
+        fmt::print(stderr, "Failed to open manifest {}\n", filename);
+        return std::nullopt;
+    }
+
+    std::vector<Job> jobs;
+    std::string line;
+    for (size_t lineNo = 1; std::getline(file, line); lineNo++) {
+        auto text = trim(line);
+        if (text.empty() || text[0] == '#')
+            continue;
+
+        auto job = parseJob(text, fmt::format("{}:{}", filename, lineNo));
+        if (!job)
+            return std::nullopt;
+        jobs.push_back(std::move(*job));
+    }
+
+    return jobs;
+}
+
+namespace {
+
+/**
+ * A job op name resolved to what it runs.
+ */
+struct ParsedOp {
+    std::optional<Op> op;
+    std::optional<Reduce> reduce;
+    std::optional<Axis> axis;
+    Pipeline::Ptr pipeline;
+
+    /**
+     * Get the number of inputs used out of available, ops use two and
+     * reductions one.
+     */
+    size_t inputCount(size_t available) const {
+        if (reduce)
+            return std::min<size_t>(available, 1);
+        if (op)
+            return std::min<size_t>(available, 2);
+        return available;
+    }
+};
+
+std::optional<ParsedOp> parseOp(const std::string_view & opName, size_t inputs) {
+    ParsedOp parsed;
+
+    // Reductions of each row or column are named like sum-rows
+    auto reduceName = opName;
+    for (auto [suffix, value] : {std::pair {"-rows", Axis::Rows}, {"-columns", Axis::Columns}}) {
+        std::string_view s = suffix;
+        if (opName.size() > s.size() && opName.substr(opName.size() - s.size()) == s) {
+            parsed.axis = value;
+            reduceName = opName.substr(0, opName.size() - s.size());
+        }
+    }
+
+    // Anything that is not an op or reduction name is a pipeline of ;
+    // separated expressions over the inputs
+    parsed.op = opFromName(opName);
+    parsed.reduce = reduceFromName(reduceName);
+    if (!parsed.op && !parsed.reduce) {
+        parsed.pipeline = Pipeline::parse(opName);
+        if (!parsed.pipeline)
+            return std::nullopt;
+    }
+
+    if (parsed.op && inputs < 2) {
+        fmt::print(stderr, "Op {} needs two inputs\n", opName);
+        return std::nullopt;
+    }
+    if (inputs == 0) {
+        fmt::print(stderr, "Op {} needs an input\n", opName);
+        return std::nullopt;
+    }
+
+    return parsed;
+}
+
+std::optional<JobResult> apply(Backend & backend,
+                               const ParsedOp & parsed,
+                               const std::vector<Table::Ptr> & tables) {
+    if (parsed.reduce && !parsed.axis) {
+        auto result = backend.reduce(*parsed.reduce, tables[0]);
+        if (!result)
+            return std::nullopt;
+        return *result;
+    }
+
+    Table::Ptr output;
+    if (parsed.reduce)
+        output = backend.reduce(*parsed.reduce, *parsed.axis, tables[0], "output");
+    else if (parsed.op)
+        output = backend.run(*parsed.op, tables[0], tables[1], "output");
+    else
+        output = backend.evaluate(*parsed.pipeline, tables);
+    if (!output)
+        return std::nullopt;
+    return output;
+}
+
+} // namespace
+
+int runOp(Backend & backend,
+          const std::string_view & op,
+          const std::vector<Table::Ptr> & tables,
+          JobResult & result) {
+    auto parsed = parseOp(op, tables.size());
+    if (!parsed)
+        return 1;
+
+    auto output = apply(backend, *parsed, tables);
+    if (!output)
+        return 4;
+
+    result = std::move(*output);
+    return 0;
+}
+
+/**
+ * Run op over a sparse one and write the output, see runJob.
+ */
+static int runSparseJob(Backend & backend,
+                        Op op,
+                        const SparseTable::Ptr & one,
+                        const Table::Ptr & two,
+                        const std::string & output) {
+    if (keepsSparsity(op, one->getFormat())) {
+        SparseTable::Ptr result;
+        {
+            TRACE_SCOPE("compute");
+            result = backend.runSparse(op, one, two, "output");
+        }
+        if (!result)
+            return 4;
+
+        TRACE_SCOPE("write");
+        return write_table(output, *result) ? 0 : 5;
+    }
+
+    Table::Ptr result;
+    {
+        TRACE_SCOPE("compute");
+        result = backend.run(op, one, two, "output");
+    }
+    if (!result)
+        return 4;
+
+    TRACE_SCOPE("write");
+    return write_table(output, *result) ? 0 : 5;
+}
+
+int runJob(Backend & backend, Table::Format format, const Job & job) {
+    TRACE_JOB(job.output);
+    auto parsed = parseOp(job.op, job.inputs.size());
+    if (!parsed)
+        return 1;
+
+    // Ops may keep their first input sparse, the other inputs are dense
+    std::vector<Table::Ptr> tables;
+    SparseTable::Ptr sparse;
+    if (parsed->op && getSparseDensity() > 0) {
+        TRACE_SCOPE("read");
+        sparse = read_sparse_table(job.inputs[0], format);
+        if (!sparse)
+            return 2;
+        if (sparse->density() > getSparseDensity()) {
+            tables.push_back(sparse->toTable());
+            sparse = nullptr;
+        }
+    }
+
+    for (size_t i = sparse ? 1 : tables.size(); i < parsed->inputCount(job.inputs.size()); i++) {
+        TRACE_SCOPE("read");
+        auto table = read_table(job.inputs[i], format);
+        if (!table)
+            return i == 0 ? 2 : 3;
+        tables.push_back(table);
+    }
+
+    if (sparse)
+        return runSparseJob(backend, *parsed->op, sparse, tables[0], job.output);
+
+    std::optional<JobResult> result;
+    {
+        TRACE_SCOPE("compute");
+        result = apply(backend, *parsed, tables);
+    }
+    if (!result)
+        return 4;
+
+    TRACE_SCOPE("write");
+    if (auto value = std::get_if<Scalar>(&*result)) {
+        auto text = std::visit([](auto x) { return fmt::format("{}\n", x); }, *value);
+        return write_text(job.output, text) ? 0 : 5;
+    }
+
+    if (!write_table(job.output, *std::get<Table::Ptr>(*result)))
+        return 5;
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "backend.hpp"
+#include "table.hpp"
+
+/**
+ * One run of the app: an op, reduction or pipeline over input files with the
+ * result written to an output file.
+ */
+struct Job {
+    /// An op name like add, a reduction name like sum or sum-rows, or a
+    /// pipeline of ; separated expressions
+    std::string op;
+    /// The input paths, each table is named after its file
+    std::vector<std::string> inputs;
+    /// The output path, - for stdout
+    std::string output;
+};
+
+/// The output of a job, a table or the value of a whole table reduction
+using JobResult = std::variant<Table::Ptr, Scalar>;
+
+/**
+ * Parse one manifest line, the output path and input paths separated by
+ * whitespace, then : and the op, eg.
+ *
+ *     out.csv one.csv two.csv: a = one + two; out = a * 3
+ *
+ * @param line the line without its newline
+ * @param where the location printed before errors, eg. manifest:3
+ *
+ * @return the job or std::nullopt if the line is malformed, the reason is
+ *         printed
+ */
+std::optional<Job> parseJob(const std::string_view & line, const std::string_view & where);
+
+/**
+ * Read every job of a manifest, one per line. Blank lines and lines starting
+ * with # are skipped.
+ *
+ * @param filename the manifest path
+ *
+ * @return the jobs or std::nullopt if the file can not be read or a line is
+ *         malformed
+ */
+std::optional<std::vector<Job>> readManifest(const std::string_view & filename);
+
+/**
+ * Run op over tables already in memory, see Job::op. Ops use the first two
+ * tables, reductions the first and pipelines all of them.
+ *
+ * @param backend the backend to run on
+ * @param op the op, reduction or pipeline
+ * @param tables the inputs, pipelines refer to them by name
+ * @param result set to the output on success
+ *
+ * @return 0 on success, 1 if the op is invalid and 4 if the backend failed
+ */
+int runOp(Backend & backend,
+          const std::string_view & op,
+          const std::vector<Table::Ptr> & tables,
+          JobResult & result);
+
+/**
+ * Set the largest density, the fraction of non zero cells, at which runJob
+ * keeps the first input of an op sparse, see SparseTable. The input is then
+ * loaded sparse, and densified if it turns out denser. The default is
+ * $EGL_MATH_SPARSE or 0, which loads every input dense.
+ *
+ * @param density the density, 0 to disable sparse inputs
+ */
+void setSparseDensity(double density);
+
+/**
+ * Get the largest density at which the first input of an op is kept sparse.
+ */
+double getSparseDensity();
+
+/**
+ * Read the inputs of job, run it on backend and write the output. Ops use
+ * the first two inputs, reductions the first and pipelines all of them.
+ * An op over a sparse first input, see setSparseDensity, runs with
+ * Backend::runSparse when the op keeps sparsity and Backend::run otherwise.
+ *
+ * @param backend the backend to run on
+ * @param format the format to read the inputs as
+ * @param job the job
+ *
+ * @return 0 on success, 1 if the op is invalid, 2 or 3 if the first or
+ *         another input could not be read, 4 if the backend failed and 5 if
+ *         the output could not be written
+ */
+int runJob(Backend & backend, Table::Format format, const Job & job);
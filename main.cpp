@@ -1,140 +1,131 @@
 #include <EGL/egl.h>
-#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
 #include <fmt/core.h>
 
-#include <fstream>
-#include <sstream>
+#include <charconv>
+#include <cstdlib>
+#include <optional>
 #include <string>
 #include <string_view>
-
-#include "Shader.hpp"
-#include "context.hpp"
+#include <vector>
+
+#include "backend.hpp"
+#include "compute_backend.hpp"
+#include "cpu_backend.hpp"
+#include "feedback_backend.hpp"
+#include "gl_backend.hpp"
+#include "job.hpp"
+#include "server.hpp"
 #include "table.hpp"
-#include "vbo.hpp"
-
-static const std::vector<int> one = {0, 1};
-static const std::vector<int> two = {2, 3};
-
-static Table::Ptr read_csv(const std::string_view & filename) {
-    std::ifstream is(filename.data());
-    if (!is.is_open())
-        return nullptr;
-
-    std::vector<int> data;
-    std::string line;
-    int val;
-    int width;
-    int height;
-
-    if (is.good()) {
-        std::getline(is, line);
-        std::stringstream ss(line);
-        while (ss >> val) {
-            data.push_back(val);
-            if (ss.peek() == ',')
-                ss.ignore();
-        }
-        width = data.size();
-        height = 1;
-    }
+#include "worker_pool.hpp"
+
+static Backend::Ptr make_backend(const std::string_view & name, unsigned threads) {
+    if (name == "cpu")
+        return std::make_shared<CPUBackend>(threads);
+    if (name == "compute")
+        return std::make_shared<ComputeBackend>(threads);
+    if (name == "feedback")
+        return std::make_shared<FeedbackBackend>(threads);
+
+    size_t cacheBytes = RenderCache::defaultMaxBytes;
+    if (auto megabytes = std::getenv("EGL_MATH_CACHE_MB"))
+        cacheBytes = std::strtoull(megabytes, nullptr, 10) << 20;
+
+    auto backend = std::make_shared<GLBackend>(1024, 1024, "..", cacheBytes);
+    fmt::print(stderr, "Context created\n");
+    return backend;
+}
 
-    while (std::getline(is, line)) {
-        std::stringstream ss(line);
-        while (ss >> val) {
-            data.push_back(val);
-            if (ss.peek() == ',')
-                ss.ignore();
-        }
-        height++;
+static bool parse_count(const std::string_view & text, size_t & count) {
+    auto res = std::from_chars(text.data(), text.data() + text.size(), count);
+    if (res.ec != std::errc() || res.ptr != text.data() + text.size()) {
+        fmt::print(stderr, "Invalid worker count {}\n", text);
+        return false;
     }
+    return true;
+}
 
-    is.close();
-
-    std::string_view tableName = filename;
-
-    auto slashPos = tableName.rfind('/');
-    if (slashPos != std::string_view::npos) {
-        tableName.remove_prefix(slashPos + 1);
+int main(int argc, char ** argv) {
+    std::string_view backendName = argc > 1 ? argv[1] : "egl";
+    std::string_view opName = argc > 2 ? argv[2] : "add";
+    std::string_view formatName = argc > 3 ? argv[3] : "r32i";
+    std::string_view outputPath = argc > 4 ? argv[4] : "output.csv";
+    std::string_view onePath = argc > 5 ? argv[5] : "../one.csv";
+    std::string_view twoPath = argc > 6 ? argv[6] : "../two.csv";
+
+    if (backendName != "cpu" && backendName != "egl" && backendName != "compute"
+        && backendName != "feedback") {
+        fmt::print(stderr, "Unknown backend {}, expected cpu, egl, compute or feedback\n",
+                   backendName);
+        return 1;
     }
 
-    auto dotPos = tableName.find('.');
-    if (dotPos != std::string_view::npos) {
-        tableName.remove_suffix(tableName.size() - dotPos);
+    // Serve mode keeps one backend per worker warm and runs the jobs sent
+    // over a Unix socket, see server.hpp
+    if (opName == "serve") {
+        size_t workers = 1;
+        if (argc > 4 && !parse_count(argv[4], workers))
+            return 1;
+        WorkerPool pool(workers, [&] { return make_backend(backendName, workers == 1 ? 0 : 1); });
+        return serve(argc > 3 ? argv[3] : "egl-math.sock", pool);
     }
 
-    fmt::print("Table {} loaded from {}\n", tableName, filename);
-    return Table::fromTable(tableName, data, width, height);
-}
+    auto format = formatFromName(formatName);
+    if (!format) {
+        fmt::print(stderr, "Unknown format {}\n", formatName);
+        return 1;
+    }
 
-static void write_csv(const std::string_view & filename, const Table::Ptr & table) {
-    std::ofstream os(filename.data());
+    // Batch mode runs every job of a manifest on one backend per worker, so
+    // the context, shaders and GL objects are created once per worker
+    bool batch = opName == "batch";
+    std::vector<Job> jobs;
+    size_t workers = 1;
+    if (batch) {
+        auto manifest = readManifest(argc > 4 ? argv[4] : "jobs.txt");
+        if (!manifest)
+            return 1;
+        jobs = std::move(*manifest);
+
+        if (argc > 5 && !parse_count(argv[5], workers))
+            return 1;
+    }
+    else {
+        jobs.push_back({std::string(opName),
+                        {std::string(onePath), std::string(twoPath)},
+                        std::string(outputPath)});
+    }
 
-    for (int r = 0; r < table->getHeight(); r++) {
-        for (int c = 0; c < table->getWidth(); c++) {
-            if (c > 0) {
-                os << ", ";
-            }
-            os << table->getCell(r, c);
+    std::vector<int> results(jobs.size());
+    if (workers == 1) {
+        auto backend = make_backend(backendName, 0);
+        for (size_t i = 0; i < jobs.size(); i++) {
+            results[i] = runJob(*backend, *format, jobs[i]);
         }
-        os << std::endl;
     }
-    os.close();
-}
-
-static int render_with(const Context & context) {
-    context.makeCurrent();
-
-    auto shader = Shader::fromFragmentPath("../shader.frag");
-    if (!shader)
-        return 1;
-
-    auto buff1 = read_csv("../one.csv");
-    if (!buff1)
-        return 2;
-
-    auto buff2 = read_csv("../two.csv");
-    if (!buff2)
-        return 3;
-
-    glClearColor(0.0, 0.0, 0.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    shader->bind();
-    shader->setInt("width", context.getWidth());
-    shader->setInt("height", context.getHeight());
-    buff1->bind(0, shader);
-    buff2->bind(1, shader);
-
-    VBO vbo;
-    vbo.loadFromPoints({
-        Vertex({1, -1, 0}, {0, 0, 0}, {1, 0}),
-        Vertex({-1, -1, 0}, {0, 0, 0}, {0, 0}),
-        Vertex({-1, 1, 0}, {0, 0, 0}, {0, 1}),
-
-        Vertex({1, -1, 0}, {0, 0, 0}, {1, 0}),
-        Vertex({-1, 1, 0}, {0, 0, 0}, {0, 1}),
-        Vertex({1, 1, 0}, {0, 0, 0}, {1, 1}),
-    });
-
-    vbo.draw();
-
-    return 0;
-}
-
-int main() {
-    Context context(90, 90);
-    fmt::print("Context created\n");
+    else {
+        // Each worker gets its own context, CPU workers one thread each
+        WorkerPool pool(workers, [&] { return make_backend(backendName, 1); });
+        for (size_t i = 0; i < jobs.size(); i++) {
+            pool.submit([&, i](Backend & backend) {
+                results[i] = runJob(backend, *format, jobs[i]);
+            });
+        }
+        pool.wait();
+    }
 
-    int res = render_with(context);
-    if (res) {
-        fmt::print("Failure during render\n");
-        return res;
+    size_t failed = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (results[i]) {
+            fmt::print(stderr, "Failure during render of {}\n", jobs[i].output);
+            failed++;
+        }
     }
 
-    auto output = std::make_shared<Table>("output", context.getWidth(),
-                                          context.getHeight());
-    output->readFromPixels();
-    write_csv("output.csv", output);
+    if (batch) {
+        fmt::print(stderr, "{} of {} jobs succeeded\n", jobs.size() - failed, jobs.size());
+        return failed ? 6 : 0;
+    }
 
-    return 0;
-}
\ No newline at end of file
+    return results[0];
+}
@@ -0,0 +1,55 @@
+// GLBackend prepends the version and the cell type for the table format:
+//   CELL     int, uint or float
+//   SAMPLER  isampler2D, usampler2D or sampler2D
+//   CELL_INTEGER defined for int and uint
+
+out CELL FragColor;
+
+uniform int width;
+uniform int height;
+
+uniform SAMPLER one;
+uniform SAMPLER two;
+
+// Operation to apply, must match Op in backend.hpp
+uniform int op;
+
+CELL getCell(SAMPLER t, int x, int y) {
+    return texelFetch(t, ivec2(x, y), 0).r;
+}
+
+CELL calc(int x, int y) {
+    CELL a = getCell(one, x, y);
+    CELL b = getCell(two, x, y);
+    switch (op) {
+        case 0:
+            return a + b;
+        case 1:
+            return a - b;
+        case 2:
+            return a * b;
+        case 3:
+            if (b == CELL(0))
+                return CELL(0);
+            return a / b;
+        case 4:
+            return min(a, b);
+        case 5:
+            return max(a, b);
+#ifdef CELL_INTEGER
+        case 6:
+            return a & b;
+        case 7:
+            return a | b;
+        case 8:
+            return a ^ b;
+#endif
+    }
+    return CELL(0);
+}
+
+void main() {
+    int x = int(gl_FragCoord.x);
+    int y = int(gl_FragCoord.y);
+    FragColor = calc(x, y);
+}
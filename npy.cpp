@@ -0,0 +1,271 @@
+#include "npy.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "file_io.hpp"
+
+// https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html
+
+static const char magic[] = "\x93NUMPY";
+static const size_t magicSize = 6;
+
+static const char * dtypeOf(Table::Format format) {
+    switch (format) {
+        case Table::Format::R32UI:
+            return "<u4";
+        case Table::Format::R32F:
+            return "<f4";
+        default:
+            return "<i4";
+    }
+}
+
+/**
+ * Find the value following 'key': in the header dictionary.
+ */
+static std::string_view headerValue(std::string_view header, const std::string_view & key) {
+    auto keyPos = header.find(fmt::format("'{}':", key));
+    if (keyPos == std::string_view::npos)
+        return {};
+    header.remove_prefix(keyPos + key.size() + 3);
+    while (!header.empty() && header.front() == ' ')
+        header.remove_prefix(1);
+    return header;
+}
+
+/**
+ * Parse the shape tuple, eg. (90, 90) or (90,), into height and width.
+ */
+static bool parseShape(std::string_view shape, int & width, int & height) {
+    if (shape.empty() || shape.front() != '(')
+        return false;
+    shape.remove_prefix(1);
+
+    int dims[2];
+    int n = 0;
+    while (!shape.empty() && shape.front() != ')') {
+        if (n == 2)
+            return false;
+        auto [ptr, ec] = std::from_chars(shape.data(), shape.data() + shape.size(), dims[n]);
+        if (ec != std::errc() || dims[n] < 0)
+            return false;
+        n++;
+        shape.remove_prefix(ptr - shape.data());
+        while (!shape.empty() && (shape.front() == ',' || shape.front() == ' '))
+            shape.remove_prefix(1);
+    }
+
+    if (n == 1) {
+        width = dims[0];
+        height = 1;
+    }
+    else if (n == 2) {
+        height = dims[0];
+        width = dims[1];
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Check the header of a mapped .npy file against format and find its
+ * payload.
+ *
+ * @param width set to the width of the array
+ * @param height set to the height of the array
+ *
+ * @return the first cell or nullptr if the file does not match, the reason
+ *         is printed
+ */
+static const char * readHeader(const MappedFile & file,
+                               const std::string_view & filename,
+                               Table::Format format,
+                               int & width,
+                               int & height) {
+    if (file.size() < magicSize + 4 || std::memcmp(file.data(), magic, magicSize) != 0) {
+        fmt::print(stderr, "{} is not a .npy file\n", filename);
+        return nullptr;
+    }
+
+    uint8_t major = file.data()[magicSize];
+    const auto * lenBytes = reinterpret_cast<const uint8_t *>(file.data() + magicSize + 2);
+    size_t headerLen;
+    size_t headerStart;
+    if (major == 1) {
+        headerLen = lenBytes[0] | lenBytes[1] << 8;
+        headerStart = magicSize + 4;
+    }
+    else if ((major == 2 || major == 3) && file.size() >= magicSize + 6) {
+        headerLen = lenBytes[0] | lenBytes[1] << 8 | lenBytes[2] << 16
+                    | static_cast<size_t>(lenBytes[3]) << 24;
+        headerStart = magicSize + 6;
+    }
+    else {
+        fmt::print(stderr, "{} has unsupported .npy version {}\n", filename, major);
+        return nullptr;
+    }
+
+    if (headerStart + headerLen > file.size()) {
+        fmt::print(stderr, "{} header is truncated\n", filename);
+        return nullptr;
+    }
+
+    std::string_view header(file.data() + headerStart, headerLen);
+
+    auto dtype = dtypeOf(format);
+    auto descr = headerValue(header, "descr");
+    if (descr.substr(0, 5) != fmt::format("'{}'", dtype)) {
+        fmt::print(stderr, "{} dtype does not match {}\n", filename, dtype);
+        return nullptr;
+    }
+
+    if (headerValue(header, "fortran_order").substr(0, 5) != "False") {
+        fmt::print(stderr, "{} must be C ordered\n", filename);
+        return nullptr;
+    }
+
+    if (!parseShape(headerValue(header, "shape"), width, height)) {
+        fmt::print(stderr, "{} must hold a 1D or 2D array\n", filename);
+        return nullptr;
+    }
+
+    size_t payloadSize = static_cast<size_t>(width) * height * sizeof(int);
+    if (headerStart + headerLen + payloadSize > file.size()) {
+        fmt::print(stderr, "{} payload is truncated\n", filename);
+        return nullptr;
+    }
+
+    return file.data() + headerStart + headerLen;
+}
+
+Table::Ptr read_npy(const std::string_view & filename, Table::Format format) {
+    MappedFile file {std::string(filename)};
+    int width, height;
+    auto payload = readHeader(file, filename, format, width, height);
+    if (!payload)
+        return nullptr;
+
+    auto tableName = tableNameOf(filename);
+    auto table = Table::uninitialized(tableName, width, height, format);
+    std::memcpy(table->data(), payload, static_cast<size_t>(width) * height * sizeof(int));
+
+    fmt::print(stderr, "Table {} loaded from {}\n", tableName, filename);
+    return table;
+}
+
+SparseTable::Ptr read_sparse_npy(const std::string_view & filename, Table::Format format) {
+    MappedFile file {std::string(filename)};
+    int width, height;
+    auto payload = readHeader(file, filename, format, width, height);
+    if (!payload)
+        return nullptr;
+
+    // The payload is only aligned by convention, copy each row out of it
+    SparseTable::Builder rows(width);
+    size_t rowBytes = static_cast<size_t>(width) * sizeof(int);
+    for (int r = 0; r < height; r++, payload += rowBytes) {
+        std::memcpy(rows.nextRow(), payload, rowBytes);
+        rows.endRow();
+    }
+
+    auto tableName = tableNameOf(filename);
+    fmt::print(stderr, "Sparse table {} loaded from {}\n", tableName, filename);
+    return rows.build(tableName, format);
+}
+
+/**
+ * Get the header of a .npy file holding a height x width array of format.
+ */
+static std::string writeHeader(Table::Format format, int width, int height) {
+    auto dict = fmt::format("{{'descr': '{}', 'fortran_order': False, 'shape': ({}, {}), }}",
+                            dtypeOf(format), height, width);
+
+    // Pad with spaces and a newline so the payload is 64 byte aligned
+    size_t prefix = magicSize + 4;
+    size_t headerLen = dict.size() + 1;
+    headerLen += (64 - (prefix + headerLen) % 64) % 64;
+
+    std::string header(magic, magicSize);
+    header += '\x01';
+    header += '\x00';
+    header += static_cast<char>(headerLen & 0xff);
+    header += static_cast<char>(headerLen >> 8);
+    header += dict;
+    header.append(headerLen - dict.size() - 1, ' ');
+    header += '\n';
+    return header;
+}
+
+bool write_npy(const std::string_view & filename, const Table & table) {
+    auto header = writeHeader(table.getFormat(), table.getWidth(), table.getHeight());
+
+    int fd = open(std::string(filename).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fmt::print(stderr, "{} could not be opened for writing: {}\n", filename,
+                   std::strerror(errno));
+        return false;
+    }
+
+    size_t payloadSize = static_cast<size_t>(table.getWidth()) * table.getHeight() * sizeof(int);
+    bool ok = writeAll(fd, header.data(), header.size())
+              && writeAll(fd, reinterpret_cast<const char *>(table.data()), payloadSize);
+    if (!ok) {
+        fmt::print(stderr, "write_npy failed: {}\n", std::strerror(errno));
+    }
+
+    if (close(fd) != 0)
+        ok = false;
+    return ok;
+}
+
+bool write_npy(const std::string_view & filename, const SparseTable & table) {
+    auto header = writeHeader(table.getFormat(), table.getWidth(), table.getHeight());
+
+    int fd = open(std::string(filename).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fmt::print(stderr, "{} could not be opened for writing: {}\n", filename,
+                   std::strerror(errno));
+        return false;
+    }
+
+    auto & rowStart = table.getRowStart();
+    auto & columns = table.getColumns();
+    auto & values = table.getValues();
+
+    // Expand and write about 1 MiB of rows at a time
+    int width = table.getWidth();
+    int rowsPerChunk = std::max<int>(1, (1 << 18) / std::max(width, 1));
+    std::vector<int> chunk(static_cast<size_t>(rowsPerChunk) * width);
+
+    bool ok = writeAll(fd, header.data(), header.size());
+    for (int first = 0; ok && first < table.getHeight(); first += rowsPerChunk) {
+        int rows = std::min(rowsPerChunk, table.getHeight() - first);
+        std::fill(chunk.begin(), chunk.end(), 0);
+        for (int r = 0; r < rows; r++) {
+            int * row = chunk.data() + static_cast<size_t>(r) * width;
+            for (size_t i = rowStart[first + r]; i < rowStart[first + r + 1]; i++) {
+                row[columns[i]] = values[i];
+            }
+        }
+        ok = writeAll(fd, reinterpret_cast<const char *>(chunk.data()),
+                      static_cast<size_t>(rows) * width * sizeof(int));
+    }
+    if (!ok) {
+        fmt::print(stderr, "write_npy failed: {}\n", std::strerror(errno));
+    }
+
+    if (close(fd) != 0)
+        ok = false;
+    return ok;
+}
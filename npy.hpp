@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string_view>
+
+#include "sparse.hpp"
+#include "table.hpp"
+
+/**
+ * Load a table from a NumPy .npy file.
+ *
+ * The file must hold a little endian, C ordered 1D or 2D array whose dtype
+ * matches format: <i4 for R32I and RGBA8, <u4 for R32UI and <f4 for R32F.
+ * The payload is memory mapped and copied into the table without parsing.
+ * A 1D array of n values becomes a table of n columns and 1 row.
+ *
+ * @param filename the path to the .npy file
+ * @param format the format of the table
+ *
+ * @return the table or nullptr if the file could not be read or does not match
+ */
+Table::Ptr read_npy(const std::string_view & filename, Table::Format format);
+
+/**
+ * Load a table from a NumPy .npy file into a SparseTable, see read_npy. The
+ * mapped payload is scanned row by row and only the non zero cells are
+ * kept, so the dense table is never allocated.
+ *
+ * @param filename the path to the .npy file
+ * @param format the format of the table
+ *
+ * @return the table or nullptr if the file could not be read or does not match
+ */
+SparseTable::Ptr read_sparse_npy(const std::string_view & filename, Table::Format format);
+
+/**
+ * Write table as a NumPy .npy file with shape (height, width), replacing
+ * filename. The cells are written as is after the header.
+ *
+ * @param filename the path to the .npy file
+ * @param table the table to write
+ *
+ * @return was the file written
+ */
+bool write_npy(const std::string_view & filename, const Table & table);
+
+/**
+ * Write every cell of a sparse table, zeros included, as a NumPy .npy file
+ * with shape (height, width), replacing filename. Rows are expanded a chunk
+ * at a time.
+ *
+ * @param filename the path to the .npy file
+ * @param table the table to write
+ *
+ * @return was the file written
+ */
+bool write_npy(const std::string_view & filename, const SparseTable & table);
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <GLES3/gl3.h>
+
+#include <memory>
+
+/**
+ * Manages a single pixel buffer object used for asynchronous texture uploads
+ * (GL_PIXEL_UNPACK_BUFFER) or readbacks (GL_PIXEL_PACK_BUFFER), with a fence
+ * to tell when the GPU has finished with it.
+ */
+class PixelBuffer {
+    GLuint pbo;
+    GLenum target;
+    GLsizeiptr size;
+    GLsync fence;
+
+public:
+    using Ptr = std::shared_ptr<PixelBuffer>;
+
+    /**
+     * Create a new PixelBuffer and allocate its storage.
+     *
+     * @param target GL_PIXEL_UNPACK_BUFFER or GL_PIXEL_PACK_BUFFER
+     * @param size the size in bytes
+     */
+    PixelBuffer(GLenum target, GLsizeiptr size)
+        : pbo(0), target(target), size(size), fence(nullptr) {
+        glGenBuffers(1, &pbo);
+        bind();
+        glBufferData(target, size, nullptr,
+                     target == GL_PIXEL_PACK_BUFFER ? GL_STREAM_READ : GL_STREAM_DRAW);
+        unbind();
+    }
+
+    PixelBuffer(const PixelBuffer &) = delete;
+    PixelBuffer & operator=(const PixelBuffer &) = delete;
+
+    ~PixelBuffer() {
+        if (fence)
+            glDeleteSync(fence);
+        glDeleteBuffers(1, &pbo);
+    }
+
+    GLenum getTarget() const {
+        return target;
+    }
+
+    GLsizeiptr getSize() const {
+        return size;
+    }
+
+    void bind() const {
+        glBindBuffer(target, pbo);
+    }
+
+    /**
+     * Unbind the target so pixel transfers use client memory again.
+     */
+    void unbind() const {
+        glBindBuffer(target, 0);
+    }
+
+    /**
+     * Bind and map the whole buffer.
+     *
+     * @param access GL_MAP_WRITE_BIT or GL_MAP_READ_BIT and any other flags
+     *
+     * @return the mapped memory or nullptr on failure
+     */
+    void * map(GLbitfield access) const {
+        bind();
+        return glMapBufferRange(target, 0, size, access);
+    }
+
+    /**
+     * Unmap the buffer, it stays bound.
+     */
+    void unmap() const {
+        glUnmapBuffer(target);
+    }
+
+    /**
+     * Insert a fence after the commands that use this buffer.
+     */
+    void fenceSync() {
+        if (fence)
+            glDeleteSync(fence);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    /**
+     * Block until the commands before the last fenceSync have completed.
+     */
+    void wait() {
+        if (!fence)
+            return;
+
+        GLenum res;
+        do {
+            res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        } while (res == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+};
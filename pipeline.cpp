@@ -0,0 +1,99 @@
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+
+Pipeline::Pipeline(std::vector<Expression::ConstPtr> steps) : steps(std::move(steps)) {}
+
+const std::vector<Expression::ConstPtr> & Pipeline::getSteps() const {
+    return steps;
+}
+
+const std::string & Pipeline::getOutput() const {
+    return steps.back()->getOutput();
+}
+
+std::vector<std::string> Pipeline::getInputs() const {
+    std::vector<std::string> inputs;
+    std::vector<std::string_view> produced;
+    for (auto & step : steps) {
+        for (auto & name : step->getTables()) {
+            if (std::find(produced.begin(), produced.end(), name) != produced.end())
+                continue;
+            if (std::find(inputs.begin(), inputs.end(), name) == inputs.end())
+                inputs.push_back(name);
+        }
+        produced.push_back(step->getOutput());
+    }
+    return inputs;
+}
+
+std::string Pipeline::normalized() const {
+    std::string res;
+    for (auto & step : steps) {
+        if (!res.empty())
+            res += ';';
+        res += step->getOutput() + '=' + step->normalized();
+    }
+    return res;
+}
+
+bool Pipeline::usesBitwise() const {
+    return std::any_of(steps.begin(), steps.end(),
+                       [](auto & step) { return step->usesBitwise(); });
+}
+
+std::string Pipeline::fragmentSource(Table::Format format) const {
+    std::vector<const Expression *> exprs;
+    for (auto & step : steps) {
+        exprs.push_back(step.get());
+    }
+    return Expression::fragmentSource(exprs, getInputs(), format);
+}
+
+std::string Pipeline::computeSource(Table::Format format) const {
+    std::vector<const Expression *> exprs;
+    for (auto & step : steps) {
+        exprs.push_back(step.get());
+    }
+    return Expression::computeSource(exprs, getInputs(), format);
+}
+
+std::string Pipeline::vertexSource(Table::Format format) const {
+    std::vector<const Expression *> exprs;
+    for (auto & step : steps) {
+        exprs.push_back(step.get());
+    }
+    return Expression::vertexSource(exprs, getInputs(), format);
+}
+
+Pipeline::Ptr Pipeline::parse(const std::string_view & source) {
+    std::vector<Expression::ConstPtr> steps;
+
+    size_t start = 0;
+    while (start <= source.size()) {
+        size_t end = source.find(';', start);
+        if (end == std::string_view::npos)
+            end = source.size();
+
+        auto step = source.substr(start, end - start);
+        if (step.find_first_not_of(" \t\r\n") != std::string_view::npos) {
+            auto expr = Expression::parse(step);
+            if (!expr) {
+                fmt::print(stderr, "pipeline: in step {}\n", steps.size() + 1);
+                return nullptr;
+            }
+            steps.push_back(expr);
+        }
+
+        start = end + 1;
+    }
+
+    if (steps.empty()) {
+        fmt::print(stderr, "pipeline: no steps\n");
+        return nullptr;
+    }
+
+    return std::make_shared<Pipeline>(std::move(steps));
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "expr.hpp"
+
+/**
+ * A sequence of expressions where each step may use the outputs of earlier
+ * steps by name, eg.
+ *
+ *     a = one + two; b = a * 3; out = max(b, 0)
+ *
+ * The output of the last step is the output of the pipeline. A step output
+ * shadows an input table or earlier step of the same name.
+ */
+class Pipeline {
+public:
+    using Ptr = std::shared_ptr<Pipeline>;
+
+private:
+    std::vector<Expression::ConstPtr> steps;
+
+public:
+    explicit Pipeline(std::vector<Expression::ConstPtr> steps);
+
+    /**
+     * Get the steps in order.
+     */
+    const std::vector<Expression::ConstPtr> & getSteps() const;
+
+    /**
+     * Get the output table name, the output of the last step.
+     */
+    const std::string & getOutput() const;
+
+    /**
+     * Get the names of the tables used before any step produces them, in
+     * order of first use. These must be supplied to the pipeline.
+     */
+    std::vector<std::string> getInputs() const;
+
+    /**
+     * Get the normalized pipeline, each step as name=normalized expression
+     * separated by ;. Equivalent sources give the same string.
+     */
+    std::string normalized() const;
+
+    /**
+     * Does any step use & | or ^, which are not defined for floats.
+     */
+    bool usesBitwise() const;
+
+    /**
+     * Generate a single fragment shader fusing every step, see
+     * Expression::fragmentSource. Samplers are named after getInputs.
+     *
+     * @param format the format of the input and output tables
+     *
+     * @return the complete fragment shader source
+     */
+    std::string fragmentSource(Table::Format format) const;
+
+    /**
+     * Generate a single compute shader fusing every step, see
+     * Expression::computeSource. Buffers are bound in the order of
+     * getInputs.
+     *
+     * @param format the format of the input and output tables
+     *
+     * @return the complete compute shader source
+     */
+    std::string computeSource(Table::Format format) const;
+
+    /**
+     * Generate a single vertex shader fusing every step for transform
+     * feedback, see Expression::vertexSource. Attribute locations follow the
+     * order of getInputs.
+     *
+     * @param format the format of the input and output tables
+     *
+     * @return the complete vertex shader source
+     */
+    std::string vertexSource(Table::Format format) const;
+
+    /**
+     * Parse source into a Pipeline, one expression per ; separated step.
+     * Empty steps are ignored.
+     *
+     * @param source the pipeline source
+     *
+     * @return the pipeline or nullptr if a step is not valid or there are none
+     */
+    static Pipeline::Ptr parse(const std::string_view & source);
+};
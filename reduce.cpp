@@ -0,0 +1,301 @@
+#include "reduce.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "framebuffer.hpp"
+#include "tile.hpp"
+
+// Each pass of a whole table reduction reduces 4x4 blocks
+static const int reduceFactor = 4;
+
+bool reducesToPair(Reduce reduce, Table::Format format) {
+    return reduce == Reduce::Count
+           || ((reduce == Reduce::Sum || reduce == Reduce::Mean)
+               && format != Table::Format::R32F);
+}
+
+Table::Format reduceLevelFormat(Reduce reduce, Table::Format format) {
+    if (reducesToPair(reduce, format))
+        return Table::Format::R32UI;
+    if (format == Table::Format::RGBA8)
+        return Table::Format::R32I;
+    return format;
+}
+
+static Scalar combine(Reduce reduce, const Scalar & a, const Scalar & b) {
+    return std::visit(
+        [&](auto x) -> Scalar {
+            auto y = std::get<decltype(x)>(b);
+            switch (reduce) {
+                case Reduce::Min:
+                    return std::min(x, y);
+                case Reduce::Max:
+                    return std::max(x, y);
+                default:
+                    return x + y;
+            }
+        },
+        a);
+}
+
+namespace {
+
+/**
+ * A render target of a reduction, pairs keep the high words in hi.
+ */
+struct Level {
+    Table::Ptr lo;
+    Table::Ptr hi;
+
+    Level(RenderCache & cache, int width, int height, Table::Format format, bool pair)
+        : lo(cache.texture(width, height, format)) {
+        if (pair)
+            hi = cache.texture(width, height, format);
+    }
+
+    /**
+     * Attach to fbo, lo as color attachment 0 and hi as 1.
+     *
+     * @return is the framebuffer complete
+     */
+    bool attach(const Framebuffer & fbo) const {
+        bool complete = fbo.attach(*lo);
+        if (hi)
+            complete = fbo.attach(*hi, 1);
+        return complete;
+    }
+
+    /**
+     * Read the attached level back to the host.
+     */
+    void read() const {
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        lo->readFromPixels();
+        if (hi) {
+            glReadBuffer(GL_COLOR_ATTACHMENT1);
+            hi->readFromPixels();
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+        }
+    }
+
+    /**
+     * Get the value of a texel after read, as the Scalar type of a
+     * reduction of format.
+     */
+    Scalar valueAt(Reduce reduce, Table::Format format, int row, int col) const {
+        if (hi) {
+            uint64_t bits = static_cast<uint32_t>(lo->getCell(row, col))
+                            | static_cast<uint64_t>(static_cast<uint32_t>(hi->getCell(row, col)))
+                                  << 32;
+            if (reduce == Reduce::Count || format == Table::Format::R32UI)
+                return bits;
+            return static_cast<int64_t>(bits);
+        }
+        if (format == Table::Format::R32F)
+            return static_cast<double>(lo->getFloat(row, col));
+        if (format == Table::Format::R32UI)
+            return static_cast<uint64_t>(static_cast<uint32_t>(lo->getCell(row, col)));
+        return static_cast<int64_t>(lo->getCell(row, col));
+    }
+};
+
+/**
+ * Set the sampler units of a reduce.frag shader.
+ */
+void bindSamplers(const Shader::Ptr & shader) {
+    shader->bind();
+    shader->setInt("src", 0);
+    shader->setInt("srcHi", 1);
+}
+
+} // namespace
+
+std::optional<Scalar> reduceTiled(const Context & context,
+                                  RenderCache & cache,
+                                  Reduce reduce,
+                                  const Shader::Ptr & first,
+                                  const Shader::Ptr & rest,
+                                  const Table & table) {
+    int width = table.getWidth();
+    int height = table.getHeight();
+    if (width == 0 || height == 0) {
+        fmt::print(stderr, "reduceTiled can not reduce empty table {}\n", table.getName());
+        return std::nullopt;
+    }
+
+    auto format = table.getFormat();
+    bool pair = reducesToPair(reduce, format);
+    auto levelFormat = reduceLevelFormat(reduce, format);
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    int tileWidth = std::min({width, context.getWidth(), maxTextureSize});
+    int tileHeight = std::min({height, context.getHeight(), maxTextureSize});
+
+    // One level per pass for a full tile, the last is a single texel
+    std::vector<Level> levels;
+    auto fbo = cache.framebuffer();
+    int levelWidth = tileWidth;
+    int levelHeight = tileHeight;
+    do {
+        levelWidth = (levelWidth + reduceFactor - 1) / reduceFactor;
+        levelHeight = (levelHeight + reduceFactor - 1) / reduceFactor;
+
+        levels.emplace_back(cache, levelWidth, levelHeight, levelFormat, pair);
+        if (!levels.back().attach(*fbo)) {
+            fmt::print(stderr, "reduceTiled framebuffer incomplete for {}\n", table.getName());
+            fbo->unbind();
+            return std::nullopt;
+        }
+    } while (levelWidth > 1 || levelHeight > 1);
+
+    if (pair)
+        fbo->drawBuffers(2);
+
+    auto & vbo = cache.getQuad();
+
+    Uniform<int> srcWidth[2], srcHeight[2];
+    for (int i = 0; i < 2; i++) {
+        auto & shader = i == 0 ? first : rest;
+        bindSamplers(shader);
+        shader->uniform<glm::ivec2>("block").set({reduceFactor, reduceFactor});
+        srcWidth[i] = shader->uniform<int>("srcWidth");
+        srcHeight[i] = shader->uniform<int>("srcHeight");
+    }
+
+    auto tileInput = cache.texture(tileWidth, tileHeight, format);
+
+    std::optional<Scalar> result;
+    for (auto & tile : splitTiles(width, height, tileWidth, tileHeight)) {
+        tileInput->copyFrom(table, tile.row, tile.col);
+        tileInput->upload();
+
+        // Only the valid region of each level is drawn, edge tiles are
+        // smaller than the levels
+        int validWidth = tile.width;
+        int validHeight = tile.height;
+        for (size_t l = 0; l < levels.size(); l++) {
+            int i = l == 0 ? 0 : 1;
+            auto & shader = i == 0 ? first : rest;
+
+            levels[l].attach(*fbo);
+
+            shader->bind();
+            srcWidth[i].set(validWidth);
+            srcHeight[i].set(validHeight);
+
+            if (l == 0) {
+                tileInput->bindTexture(0);
+            }
+            else {
+                levels[l - 1].lo->bindTexture(0);
+                if (pair)
+                    levels[l - 1].hi->bindTexture(1);
+            }
+
+            validWidth = (validWidth + reduceFactor - 1) / reduceFactor;
+            validHeight = (validHeight + reduceFactor - 1) / reduceFactor;
+            GLState::viewport(0, 0, validWidth, validHeight);
+            vbo.draw();
+        }
+
+        levels.back().read();
+        auto partial = levels.back().valueAt(reduce, format, 0, 0);
+        result = result ? combine(reduce, *result, partial) : partial;
+    }
+
+    fbo->unbind();
+
+    if (result && reduce == Reduce::Mean) {
+        double cells = static_cast<double>(width) * height;
+        result = std::visit([&](auto total) -> Scalar { return total / cells; }, *result);
+    }
+
+    return result;
+}
+
+Table::Ptr reduceAxisTiled(const Context & context,
+                           RenderCache & cache,
+                           Reduce reduce,
+                           Axis axis,
+                           const Shader::Ptr & shader,
+                           const Table & table,
+                           const std::string_view & name) {
+    int width = table.getWidth();
+    int height = table.getHeight();
+    if (width == 0 || height == 0) {
+        fmt::print(stderr, "reduceAxisTiled can not reduce empty table {}\n", table.getName());
+        return nullptr;
+    }
+
+    auto format = table.getFormat();
+    bool pair = reducesToPair(reduce, format);
+    bool rows = axis == Axis::Rows;
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    int tileWidth = std::min({width, context.getWidth(), maxTextureSize});
+    int tileHeight = std::min({height, context.getHeight(), maxTextureSize});
+
+    // A single pass where each texel loops over its line of the tile
+    auto fbo = cache.framebuffer();
+    Level line(cache, rows ? 1 : tileWidth, rows ? tileHeight : 1, reduceLevelFormat(reduce, format),
+               pair);
+    if (!line.attach(*fbo)) {
+        fmt::print(stderr, "reduceAxisTiled framebuffer incomplete for {}\n", table.getName());
+        fbo->unbind();
+        return nullptr;
+    }
+    if (pair)
+        fbo->drawBuffers(2);
+
+    auto & vbo = cache.getQuad();
+
+    bindSamplers(shader);
+    auto block = shader->uniform<glm::ivec2>("block");
+    auto srcWidth = shader->uniform<int>("srcWidth");
+    auto srcHeight = shader->uniform<int>("srcHeight");
+
+    auto tileInput = cache.texture(tileWidth, tileHeight, format);
+    tileInput->bindTexture(0);
+
+    // Lines longer than a tile are combined on the host
+    std::vector<std::optional<Scalar>> acc(rows ? height : width);
+
+    for (auto & tile : splitTiles(width, height, tileWidth, tileHeight)) {
+        tileInput->copyFrom(table, tile.row, tile.col);
+        tileInput->upload();
+
+        block.set(rows ? glm::ivec2(tile.width, 1) : glm::ivec2(1, tile.height));
+        srcWidth.set(tile.width);
+        srcHeight.set(tile.height);
+
+        GLState::viewport(0, 0, rows ? 1 : tile.width, rows ? tile.height : 1);
+        vbo.draw();
+
+        // Only the thin line target is read back
+        line.read();
+        int count = rows ? tile.height : tile.width;
+        for (int i = 0; i < count; i++) {
+            auto partial = line.valueAt(reduce, format, rows ? i : 0, rows ? 0 : i);
+            auto & total = acc[rows ? tile.row + i : tile.col + i];
+            total = total ? combine(reduce, *total, partial) : partial;
+        }
+    }
+
+    fbo->unbind();
+
+    auto outputFormat = reduceOutputFormat(reduce, format);
+    auto output = rows ? std::make_shared<Table>(name, 1, height, outputFormat)
+                       : std::make_shared<Table>(name, width, 1, outputFormat);
+    size_t lineLength = rows ? width : height;
+    for (size_t i = 0; i < acc.size(); i++) {
+        setReduced(*output, rows ? i : 0, rows ? 0 : i, reduce, *acc[i], lineLength);
+    }
+    return output;
+}
@@ -0,0 +1,99 @@
+// Reduces each block of src to one texel. GLBackend prepends the version
+// and defines:
+//   CELL, SAMPLER  the type of the values read from src
+//   FIRST          src is the table, otherwise the previous level
+//   PACKED         src is an RGBA8 table of packed ints
+//   PAIR           accumulate a 64 bit sum as a lo, hi pair of uints, the
+//                  previous level holds lo in src and hi in srcHi
+//   CELL_SIGNED    sign extend cells into the pair
+//   COUNT          count non zero cells into the pair
+//   MIN, MAX       smallest or largest cell, otherwise the CELL sum
+
+// Size of the block of src reduced by each texel
+uniform ivec2 block;
+
+uniform SAMPLER src;
+uniform usampler2D srcHi;
+
+// Size of the valid region of src, cells outside are padding
+uniform int srcWidth;
+uniform int srcHeight;
+
+#ifdef PACKED
+int color_to_int(vec4 c) {
+    int res = 0;
+    for (int i = 0; i < 4; i++) {
+        res = res << 8;
+        res = res | (int(c[3-i] * 255.) & 255);
+    }
+    return res;
+}
+
+CELL cellAt(ivec2 p) {
+    return color_to_int(texelFetch(src, p, 0));
+}
+#else
+CELL cellAt(ivec2 p) {
+    return texelFetch(src, p, 0).r;
+}
+#endif
+
+#ifdef PAIR
+layout(location = 0) out uint lo;
+layout(location = 1) out uint hi;
+
+void add64(inout uvec2 acc, uvec2 x) {
+    uint sum = acc.x + x.x;
+    acc.y += x.y + (sum < acc.x ? 1u : 0u);
+    acc.x = sum;
+}
+
+uvec2 valueAt(ivec2 p) {
+#if !defined(FIRST)
+    return uvec2(cellAt(p), texelFetch(srcHi, p, 0).r);
+#elif defined(COUNT)
+    return uvec2(cellAt(p) != CELL(0) ? 1u : 0u, 0u);
+#elif defined(CELL_SIGNED)
+    CELL c = cellAt(p);
+    return uvec2(uint(c), c < 0 ? 0xFFFFFFFFu : 0u);
+#else
+    return uvec2(uint(cellAt(p)), 0u);
+#endif
+}
+#else
+out CELL FragColor;
+#endif
+
+void main() {
+    ivec2 base = ivec2(gl_FragCoord.xy) * block;
+    ivec2 end = min(base + block, ivec2(srcWidth, srcHeight));
+
+#if defined(PAIR)
+    uvec2 acc = uvec2(0u);
+#elif defined(MIN) || defined(MAX)
+    CELL acc = cellAt(base);
+#else
+    CELL acc = CELL(0);
+#endif
+
+    for (int y = base.y; y < end.y; y++) {
+        for (int x = base.x; x < end.x; x++) {
+#if defined(PAIR)
+            add64(acc, valueAt(ivec2(x, y)));
+#elif defined(MIN)
+            acc = min(acc, cellAt(ivec2(x, y)));
+#elif defined(MAX)
+            acc = max(acc, cellAt(ivec2(x, y)));
+#else
+            acc += cellAt(ivec2(x, y));
+#endif
+        }
+    }
+
+#ifdef PAIR
+    lo = acc.x;
+    hi = acc.y;
+#else
+    FragColor = acc;
+#endif
+}
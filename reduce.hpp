@@ -0,0 +1,76 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+#include "Shader.hpp"
+#include "backend.hpp"
+#include "context.hpp"
+#include "render_cache.hpp"
+#include "table.hpp"
+
+/**
+ * Does reduce accumulate a 64 bit sum as a pair of R32UI levels for tables of
+ * format. True for counts and for integer sums.
+ */
+bool reducesToPair(Reduce reduce, Table::Format format);
+
+/**
+ * Get the format of the intermediate levels when reducing a table of format.
+ */
+Table::Format reduceLevelFormat(Reduce reduce, Table::Format format);
+
+/**
+ * Reduce table to a single value on the GPU.
+ *
+ * Each tile of the table is uploaded and reduced by a chain of passes, every
+ * pass drawing one texel per 4x4 block of the previous level, until a single
+ * texel remains. Only that texel is read back and the tile results are
+ * combined on the host. Tiles are limited by the context surface and
+ * GL_MAX_TEXTURE_SIZE as in renderTiled.
+ *
+ * Integer sums and counts are carried as 64 bit lo, hi pairs written to two
+ * color attachments so they can not wrap.
+ *
+ * @param context the current context
+ * @param cache the quad and textures to reuse
+ * @param reduce the reduction
+ * @param first reduce.frag compiled to read the table
+ * @param rest reduce.frag compiled to read a previous level
+ * @param table the table to reduce
+ *
+ * @return the result or std::nullopt if the table is empty or can not be
+ *         rendered
+ */
+std::optional<Scalar> reduceTiled(const Context & context,
+                                  RenderCache & cache,
+                                  Reduce reduce,
+                                  const Shader::Ptr & first,
+                                  const Shader::Ptr & rest,
+                                  const Table & table);
+
+/**
+ * Reduce every row or column of table on the GPU.
+ *
+ * Each tile is reduced in one pass drawing a one texel wide line, every
+ * texel looping over its row or column of the tile. Only that line is read
+ * back and lines longer than a tile are combined on the host.
+ *
+ * @param context the current context
+ * @param cache the quad and textures to reuse
+ * @param reduce the reduction
+ * @param axis reduce rows into a 1xH table or columns into a Wx1 table
+ * @param shader reduce.frag compiled to read the table
+ * @param table the table to reduce
+ * @param name the name of the output table
+ *
+ * @return the output table, see reduceOutputFormat, or nullptr if the table
+ *         is empty or can not be rendered
+ */
+Table::Ptr reduceAxisTiled(const Context & context,
+                           RenderCache & cache,
+                           Reduce reduce,
+                           Axis axis,
+                           const Shader::Ptr & shader,
+                           const Table & table,
+                           const std::string_view & name);
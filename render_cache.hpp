@@ -0,0 +1,196 @@
+#pragma once
+
+#include <GLES3/gl3.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "framebuffer.hpp"
+#include "pbo.hpp"
+#include "table.hpp"
+#include "vbo.hpp"
+
+/**
+ * GL objects kept by a backend across renders, so repeated jobs on the same
+ * context do not create the quad, tile textures, framebuffers or pixel
+ * buffers again.
+ *
+ * Textures, framebuffers and buffers are handed out as shared pointers and
+ * are free again once the caller drops its pointer. Textures are matched by
+ * size and format and keep their storage, so a reused texture is only
+ * updated with glTexSubImage2D. When the textures and buffers hold more
+ * than the memory limit, the least recently used free ones are deleted.
+ *
+ * Framebuffers own no storage and do not count against the limit, but a
+ * deleted texture keeps its storage while attached to a framebuffer that is
+ * not bound. The free framebuffers are deleted with every evicted texture so
+ * they can not hold on to it.
+ */
+class RenderCache {
+    template <typename T>
+    struct Entry {
+        std::shared_ptr<T> object;
+        size_t bytes;
+        uint64_t lastUse;
+
+        bool isFree() const {
+            return object.use_count() == 1;
+        }
+    };
+
+    VBO quad;
+    std::vector<Entry<Table>> textures;
+    std::vector<Entry<PixelBuffer>> buffers;
+    std::vector<Framebuffer::Ptr> framebuffers;
+    size_t bytes = 0;
+    size_t maxBytes;
+    uint64_t clock = 0;
+
+    /**
+     * Delete the least recently used free texture or buffer.
+     *
+     * @return was one deleted
+     */
+    bool evictOne() {
+        auto oldest = [](auto & entries) {
+            auto found = entries.end();
+            for (auto it = entries.begin(); it != entries.end(); it++) {
+                if (it->isFree() && (found == entries.end() || it->lastUse < found->lastUse))
+                    found = it;
+            }
+            return found;
+        };
+
+        auto texture = oldest(textures);
+        auto buffer = oldest(buffers);
+        bool useTexture = texture != textures.end()
+                          && (buffer == buffers.end() || texture->lastUse < buffer->lastUse);
+        if (useTexture) {
+            bytes -= texture->bytes;
+            textures.erase(texture);
+            framebuffers.erase(std::remove_if(framebuffers.begin(), framebuffers.end(),
+                                              [](auto & fbo) { return fbo.use_count() == 1; }),
+                               framebuffers.end());
+            return true;
+        }
+        if (buffer != buffers.end()) {
+            bytes -= buffer->bytes;
+            buffers.erase(buffer);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Evict until the cache fits its limit or nothing else is free. Objects
+     * in use are never deleted, so the limit can be exceeded while they are.
+     */
+    void trim() {
+        while (bytes > maxBytes && evictOne()) {
+        }
+    }
+
+public:
+    using Ptr = std::shared_ptr<RenderCache>;
+
+    /// Default memory limit of the textures and buffers
+    static constexpr size_t defaultMaxBytes = size_t(512) << 20;
+
+    /**
+     * Create the cache and load the fullscreen quad. A context must be
+     * current.
+     *
+     * @param maxBytes the memory limit of the textures and buffers
+     */
+    explicit RenderCache(size_t maxBytes = defaultMaxBytes) : maxBytes(maxBytes) {
+        quad.loadFromPoints(fullscreen_quad());
+    }
+
+    RenderCache(const RenderCache &) = delete;
+    RenderCache & operator=(const RenderCache &) = delete;
+
+    /**
+     * Get the fullscreen quad.
+     */
+    const VBO & getQuad() const {
+        return quad;
+    }
+
+    size_t getBytes() const {
+        return bytes;
+    }
+
+    size_t getMaxBytes() const {
+        return maxBytes;
+    }
+
+    /**
+     * Set the memory limit, evicting free objects to fit it.
+     */
+    void setMaxBytes(size_t maxBytes) {
+        this->maxBytes = maxBytes;
+        trim();
+    }
+
+    /**
+     * Get a free texture with storage for a width x height table of format,
+     * creating one if none is free. The host data is not cleared.
+     */
+    Table::Ptr texture(int width, int height, Table::Format format) {
+        for (auto & entry : textures) {
+            auto & texture = entry.object;
+            if (entry.isFree() && texture->getWidth() == width
+                && texture->getHeight() == height && texture->getFormat() == format) {
+                entry.lastUse = ++clock;
+                return texture;
+            }
+        }
+
+        auto texture = Table::uninitialized("tile", width, height, format);
+        texture->allocate();
+        size_t size = static_cast<size_t>(width) * height * sizeof(int);
+        textures.push_back({texture, size, ++clock});
+        bytes += size;
+        trim();
+        return texture;
+    }
+
+    /**
+     * Get a free pixel buffer of target and size, creating one if none is
+     * free.
+     */
+    PixelBuffer::Ptr buffer(GLenum target, GLsizeiptr size) {
+        for (auto & entry : buffers) {
+            auto & buffer = entry.object;
+            if (entry.isFree() && buffer->getTarget() == target && buffer->getSize() == size) {
+                entry.lastUse = ++clock;
+                return buffer;
+            }
+        }
+
+        auto buffer = std::make_shared<PixelBuffer>(target, size);
+        buffers.push_back({buffer, static_cast<size_t>(size), ++clock});
+        bytes += size;
+        trim();
+        return buffer;
+    }
+
+    /**
+     * Get a free framebuffer drawing to attachment 0 only, creating one if
+     * none is free. Attach a texture before drawing.
+     */
+    Framebuffer::Ptr framebuffer() {
+        for (auto & framebuffer : framebuffers) {
+            if (framebuffer.use_count() == 1) {
+                framebuffer->reset();
+                return framebuffer;
+            }
+        }
+
+        auto framebuffer = std::make_shared<Framebuffer>();
+        framebuffers.push_back(framebuffer);
+        return framebuffer;
+    }
+};
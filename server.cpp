@@ -0,0 +1,251 @@
+#include "server.hpp"
+
+#include <fmt/core.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_io.hpp"
+#include "job.hpp"
+#include "trace.hpp"
+
+// Largest table accepted in a request, 2^30 cells or 4 GiB
+static const uint64_t maxCells = uint64_t(1) << 30;
+// Longest op or table name accepted in a request
+static const uint32_t maxTextBytes = 1 << 20;
+// Most tables accepted in a request
+static const uint32_t maxTables = 1024;
+
+static std::atomic<bool> stopping {false};
+
+static void onSignal(int) {
+    stopping = true;
+}
+
+namespace {
+
+/**
+ * Reads and writes the fields of the protocol on one connection.
+ */
+class Connection {
+    int fd;
+
+public:
+    explicit Connection(int fd) : fd(fd) {}
+
+    template <typename T>
+    bool read(T & value) {
+        return readAll(fd, reinterpret_cast<char *>(&value), sizeof(value));
+    }
+
+    /**
+     * Read the bytes of a string whose length was read already, at most
+     * maxTextBytes so the peer can not make us allocate any size.
+     */
+    bool readText(uint32_t length, std::string & text) {
+        if (length > maxTextBytes) {
+            fmt::print(stderr, "serve: text of {} bytes, at most {} allowed\n", length,
+                       maxTextBytes);
+            return false;
+        }
+        text.resize(length);
+        return readAll(fd, text.data(), length);
+    }
+
+    bool read(std::string & text) {
+        uint32_t length;
+        return read(length) && readText(length, text);
+    }
+
+    Table::Ptr readTable() {
+        std::string name;
+        uint32_t format;
+        int32_t width, height;
+        if (!read(name) || !read(format) || !read(width) || !read(height))
+            return nullptr;
+
+        if (format > static_cast<uint32_t>(Table::Format::R32F) || width < 0 || height < 0
+            || static_cast<uint64_t>(width) * height > maxCells) {
+            fmt::print(stderr, "serve: bad table {} {}x{} format {}\n", name, width, height,
+                       format);
+            return nullptr;
+        }
+
+        auto table =
+            Table::uninitialized(name, width, height, static_cast<Table::Format>(format));
+        size_t bytes = static_cast<size_t>(width) * height * sizeof(int);
+        if (!readAll(fd, reinterpret_cast<char *>(table->data()), bytes))
+            return nullptr;
+        return table;
+    }
+
+    template <typename T>
+    void write(std::string & out, const T & value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    bool writeResponse(int status, const JobResult * result) {
+        std::string out;
+        write(out, static_cast<uint32_t>(status));
+
+        if (status == 0 && std::holds_alternative<Scalar>(*result)) {
+            auto & value = std::get<Scalar>(*result);
+            write(out, uint32_t(1));
+            write(out, static_cast<uint32_t>(value.index()));
+            std::visit([&](auto x) { write(out, x); }, value);
+        }
+        else if (status == 0) {
+            auto & table = *std::get<Table::Ptr>(*result);
+            write(out, uint32_t(0));
+            write(out, static_cast<uint32_t>(table.getName().size()));
+            out += table.getName();
+            write(out, static_cast<uint32_t>(table.getFormat()));
+            write(out, static_cast<int32_t>(table.getWidth()));
+            write(out, static_cast<int32_t>(table.getHeight()));
+            if (!writeAll(fd, out.data(), out.size()))
+                return false;
+            // Cells go straight from the table
+            size_t bytes = static_cast<size_t>(table.getWidth()) * table.getHeight() * sizeof(int);
+            return writeAll(fd, reinterpret_cast<const char *>(table.data()), bytes);
+        }
+
+        return writeAll(fd, out.data(), out.size());
+    }
+
+    /**
+     * Serve requests until the peer closes the connection or sends a
+     * malformed request.
+     */
+    void run(WorkerPool & pool) {
+        while (true) {
+            // A closed connection ends between requests, anything later is
+            // a malformed request
+            uint32_t length;
+            if (!read(length))
+                return;
+
+            std::string op;
+            uint32_t count = 0;
+            bool valid = readText(length, op) && read(count);
+            if (valid && count > maxTables) {
+                fmt::print(stderr, "serve: {} tables, at most {} allowed\n", count, maxTables);
+                valid = false;
+            }
+
+            std::vector<Table::Ptr> tables;
+            for (uint32_t i = 0; valid && i < count; i++) {
+                auto table = readTable();
+                valid = table != nullptr;
+                tables.push_back(table);
+            }
+            if (!valid) {
+                writeResponse(1, nullptr);
+                return;
+            }
+
+            std::promise<int> status;
+            JobResult result;
+            pool.submit([&](Backend & backend) {
+                TRACE_JOB(op);
+                status.set_value(runOp(backend, op, tables, result));
+            });
+
+            if (!writeResponse(status.get_future().get(), &result))
+                return;
+        }
+    }
+};
+
+} // namespace
+
+int serve(const std::string_view & socketPath, WorkerPool & pool) {
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        fmt::print(stderr, "serve: socket path {} is too long\n", socketPath);
+        return 1;
+    }
+    std::memcpy(addr.sun_path, socketPath.data(), socketPath.size());
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(addr.sun_path);
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0
+        || listen(listenFd, SOMAXCONN) < 0) {
+        fmt::print(stderr, "serve: failed to listen on {}: {}\n", socketPath, strerror(errno));
+        if (listenFd >= 0)
+            close(listenFd);
+        return 1;
+    }
+
+    // Without SA_RESTART so accept returns on a signal
+    struct sigaction action {};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    fmt::print(stderr, "Serving on {} with {} workers\n", socketPath, pool.size());
+
+    // One thread per connection, joined once it is done
+    struct Client {
+        int fd;
+        std::atomic<bool> done {false};
+        std::thread thread;
+    };
+    std::list<Client> clients;
+
+    auto reap = [&](bool all) {
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (!all && !it->done) {
+                it++;
+                continue;
+            }
+            it->thread.join();
+            close(it->fd);
+            it = clients.erase(it);
+        }
+    };
+
+    while (!stopping) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fmt::print(stderr, "serve: accept failed: {}\n", strerror(errno));
+            break;
+        }
+
+        reap(false);
+
+        auto & client = clients.emplace_back();
+        client.fd = fd;
+        client.thread = std::thread([&pool, &client] {
+            Connection(client.fd).run(pool);
+            // The peer sees the end now, the fd is closed when reaped
+            shutdown(client.fd, SHUT_RDWR);
+            client.done = true;
+        });
+    }
+
+    close(listenFd);
+    unlink(addr.sun_path);
+
+    // Wake connections blocked on a read so their threads can finish
+    for (auto & client : clients) {
+        shutdown(client.fd, SHUT_RDWR);
+    }
+    reap(true);
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string_view>
+
+#include "worker_pool.hpp"
+
+/**
+ * Serve jobs over a Unix domain socket until SIGINT or SIGTERM.
+ *
+ * Each connection sends any number of requests and gets one response per
+ * request, in order. Requests of different connections run in parallel on
+ * the workers of pool. All integers are native endian, lengths and counts
+ * are uint32_t.
+ *
+ * A request is the op, see Job::op, followed by the input tables:
+ *
+ *     length, op bytes
+ *     table count
+ *     per table: length, name bytes, format, int32_t width, int32_t height,
+ *                width * height cells of 4 bytes in row major order
+ *
+ * The format is the index of Table::Format, 0 RGBA8, 1 R32I, 2 R32UI and
+ * 3 R32F. Tables are named for pipelines, the first two are the operands of
+ * an op and the first is the input of a reduction.
+ *
+ * A response starts with the status of runOp, 0 on success. On success a
+ * kind follows, 0 for a table and 1 for the value of a whole table
+ * reduction:
+ *
+ *     table: length, name bytes, format, int32_t width, int32_t height, cells
+ *     value: type, 0 int64_t, 1 uint64_t or 2 double, then the 8 bytes
+ *
+ * Ops and names are at most 1 MiB, a request holds at most 1024 tables and
+ * a table at most 2^30 cells. A malformed request, or one over these
+ * limits, gets status 1 and the connection is closed.
+ *
+ * @param socketPath the path to bind, an existing socket there is replaced
+ * @param pool the workers to run jobs on
+ *
+ * @return 0 after a clean shutdown or 1 if the socket could not be bound
+ */
+int serve(const std::string_view & socketPath, WorkerPool & pool);
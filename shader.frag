@@ -13,6 +13,9 @@ in vec2 FragTex;
 uniform sampler2D one;
 uniform sampler2D two;
 
+// Operation to apply, must match Op in backend.hpp
+uniform int op;
+
 int color_to_int(vec4 c) {
     int res = 0;
     for (int i = 0; i < 4; i++) {
@@ -42,7 +45,29 @@ int getCell(sampler2D t, int x, int y) {
 int calc(int x, int y) {
     int a = getCell(one, x, y);
     int b = getCell(two, x, y);
-    return b+a;
+    switch (op) {
+        case 0:
+            return a + b;
+        case 1:
+            return a - b;
+        case 2:
+            return a * b;
+        case 3:
+            if (b == 0)
+                return 0;
+            return a / b;
+        case 4:
+            return min(a, b);
+        case 5:
+            return max(a, b);
+        case 6:
+            return a & b;
+        case 7:
+            return a | b;
+        case 8:
+            return a ^ b;
+    }
+    return 0;
 }
 
 void main() {
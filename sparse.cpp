@@ -0,0 +1,84 @@
+#include "sparse.hpp"
+
+SparseTable::SparseTable(const std::string_view & name,
+                         std::shared_ptr<const std::vector<size_t>> rowStart,
+                         std::shared_ptr<const std::vector<int>> columns,
+                         std::vector<int> values,
+                         int width,
+                         int height,
+                         Format format)
+    : name(name),
+      rowStart(std::move(rowStart)),
+      columns(std::move(columns)),
+      values(std::move(values)),
+      width(width),
+      height(height),
+      format(format) {}
+
+double SparseTable::density() const {
+    size_t cells = static_cast<size_t>(width) * height;
+    return cells ? static_cast<double>(values.size()) / cells : 0;
+}
+
+std::vector<int> SparseTable::gather(const Table & table) const {
+    std::vector<int> cells(values.size());
+    auto & starts = *rowStart;
+    auto & cols = *columns;
+    for (int r = 0; r < height; r++) {
+        const int * row = table.data() + static_cast<size_t>(r) * width;
+        for (size_t i = starts[r]; i < starts[r + 1]; i++) {
+            cells[i] = row[cols[i]];
+        }
+    }
+    return cells;
+}
+
+Table::Ptr SparseTable::toTable() const {
+    auto table = std::make_shared<Table>(name, width, height, format);
+    auto & starts = *rowStart;
+    auto & cols = *columns;
+    for (int r = 0; r < height; r++) {
+        int * row = table->data() + static_cast<size_t>(r) * width;
+        for (size_t i = starts[r]; i < starts[r + 1]; i++) {
+            row[cols[i]] = values[i];
+        }
+    }
+    return table;
+}
+
+SparseTable::Ptr SparseTable::fromTable(const Table & table) {
+    Builder builder(table.getWidth());
+    for (int r = 0; r < table.getHeight(); r++) {
+        std::copy_n(table.data() + static_cast<size_t>(r) * table.getWidth(), table.getWidth(),
+                    builder.nextRow());
+        builder.endRow();
+    }
+    return builder.build(table.getName(), table.getFormat());
+}
+
+SparseTable::Ptr SparseTable::withPattern(const std::string_view & name,
+                                          const SparseTable & other,
+                                          std::vector<int> && values) {
+    return std::make_shared<SparseTable>(name, other.rowStart, other.columns, std::move(values),
+                                         other.width, other.height, other.format);
+}
+
+void SparseTable::Builder::endRow() {
+    for (int c = 0; c < static_cast<int>(row.size()); c++) {
+        if (row[c] != 0) {
+            columns.push_back(c);
+            values.push_back(row[c]);
+        }
+    }
+    rowStart.push_back(values.size());
+}
+
+SparseTable::Ptr SparseTable::Builder::build(const std::string_view & name, Format format) {
+    int height = rowStart.size() - 1;
+    columns.shrink_to_fit();
+    values.shrink_to_fit();
+    return std::make_shared<SparseTable>(
+        name, std::make_shared<const std::vector<size_t>>(std::move(rowStart)),
+        std::make_shared<const std::vector<int>>(std::move(columns)), std::move(values),
+        row.size(), height, format);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "table.hpp"
+
+/**
+ * A table that stores only its non zero cells, in compressed sparse row
+ * form: the cells of row r are values[rowStart[r]] to values[rowStart[r + 1]]
+ * in column order, with their columns in columns. Memory is proportional to
+ * the number of non zero cells instead of width * height.
+ *
+ * A cell is zero when its 32 bits are, so a -0.0 float is stored. The
+ * pattern of row starts and columns is immutable and shared by the tables
+ * computed from this one with withPattern.
+ */
+class SparseTable {
+public:
+    using Ptr = std::shared_ptr<SparseTable>;
+    using Format = Table::Format;
+
+private:
+    std::string name;
+    std::shared_ptr<const std::vector<size_t>> rowStart;
+    std::shared_ptr<const std::vector<int>> columns;
+    std::vector<int> values;
+    int width, height;
+    Format format;
+
+public:
+    /**
+     * Create a table from its compressed rows.
+     *
+     * @param rowStart height + 1 offsets into columns and values
+     * @param columns the column of each value, ascending in each row
+     * @param values the non zero cells
+     */
+    SparseTable(const std::string_view & name,
+                std::shared_ptr<const std::vector<size_t>> rowStart,
+                std::shared_ptr<const std::vector<int>> columns,
+                std::vector<int> values,
+                int width,
+                int height,
+                Format format = Format::RGBA8);
+
+    SparseTable(const SparseTable &) = delete;
+    SparseTable & operator=(const SparseTable &) = delete;
+
+    const std::string & getName() const {
+        return name;
+    }
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    Format getFormat() const {
+        return format;
+    }
+
+    const std::vector<size_t> & getRowStart() const {
+        return *rowStart;
+    }
+
+    const std::vector<int> & getColumns() const {
+        return *columns;
+    }
+
+    const std::vector<int> & getValues() const {
+        return values;
+    }
+
+    /**
+     * Get the number of stored cells.
+     */
+    size_t nonZeros() const {
+        return values.size();
+    }
+
+    /**
+     * Get the fraction of cells that are stored, 0 for an empty table.
+     */
+    double density() const;
+
+    /**
+     * Get the cells of table at the stored cells of this table, in the
+     * order of getValues.
+     *
+     * @param table a table of the same size
+     */
+    std::vector<int> gather(const Table & table) const;
+
+    /**
+     * Copy every cell, zeros included, into a new table of the same name.
+     */
+    Table::Ptr toTable() const;
+
+    /**
+     * Create a table storing the non zero cells of table.
+     */
+    static Ptr fromTable(const Table & table);
+
+    /**
+     * Create a table with the pattern of other and new values, without
+     * copying the pattern.
+     *
+     * @param values one value per stored cell of other
+     */
+    static Ptr withPattern(const std::string_view & name,
+                           const SparseTable & other,
+                           std::vector<int> && values);
+
+    /**
+     * Collects the non zero cells of a table one dense row at a time, for
+     * loaders that never hold the whole table.
+     */
+    class Builder {
+        std::vector<size_t> rowStart {0};
+        std::vector<int> columns;
+        std::vector<int> values;
+        std::vector<int> row;
+
+    public:
+        /**
+         * @param width the number of cells in each row
+         */
+        explicit Builder(int width) : row(width) {}
+
+        /**
+         * Get the buffer to write the next row into.
+         */
+        int * nextRow() {
+            return row.data();
+        }
+
+        /**
+         * Store the non zero cells of the row written to nextRow.
+         */
+        void endRow();
+
+        /**
+         * Create the table from the rows ended so far, which empties the
+         * builder.
+         */
+        Ptr build(const std::string_view & name, Format format);
+    };
+};
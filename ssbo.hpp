@@ -0,0 +1,75 @@
+#pragma once
+
+#include <GLES3/gl31.h>
+
+#include <memory>
+
+/**
+ * Manages a single shader storage buffer object, the array a compute shader
+ * reads cells from or writes them to.
+ */
+class StorageBuffer {
+    GLuint ssbo;
+    GLsizeiptr size;
+
+public:
+    using Ptr = std::shared_ptr<StorageBuffer>;
+
+    /**
+     * Create a new StorageBuffer and allocate its storage.
+     *
+     * @param size the size in bytes
+     */
+    explicit StorageBuffer(GLsizeiptr size) : ssbo(0), size(size) {
+        glGenBuffers(1, &ssbo);
+        bind();
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+    }
+
+    StorageBuffer(const StorageBuffer &) = delete;
+    StorageBuffer & operator=(const StorageBuffer &) = delete;
+
+    ~StorageBuffer() {
+        glDeleteBuffers(1, &ssbo);
+    }
+
+    GLsizeiptr getSize() const {
+        return size;
+    }
+
+    void bind() const {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    }
+
+    /**
+     * Bind to the storage block binding index of the compute shaders.
+     */
+    void bindBase(GLuint index) const {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, ssbo);
+    }
+
+    /**
+     * Copy bytes of data to the start of the buffer.
+     */
+    void write(const void * data, GLsizeiptr bytes) const {
+        bind();
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, data);
+    }
+
+    /**
+     * Bind and map the first bytes of the buffer for reading.
+     *
+     * @return the mapped memory or nullptr on failure
+     */
+    const void * mapRead(GLsizeiptr bytes) const {
+        bind();
+        return glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    }
+
+    /**
+     * Unmap the buffer, it stays bound.
+     */
+    void unmap() const {
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    }
+};
@@ -1,43 +1,132 @@
 #pragma once
 
-#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
+#include <fmt/core.h>
 
+#include <algorithm>
+#include <cstring>
 #include <glm/glm.hpp>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
 
 #include "Shader.hpp"
+#include "gl_state.hpp"
+#include "trace.hpp"
 
 class Table {
-    GLuint texId;
+public:
+    /**
+     * Texture format of the table. Every cell is 32 bits on the host.
+     */
+    enum class Format {
+        /// int packed into the bytes of an RGBA8 texture, see shader.frag
+        RGBA8,
+        /// int stored in a GL_R32I texture
+        R32I,
+        /// unsigned int stored in a GL_R32UI texture
+        R32UI,
+        /// float stored in a GL_R32F texture
+        R32F,
+    };
+
+private:
+    mutable GLuint texId;
+    // Has the texture storage been allocated, after that uploads only
+    // replace the cells
+    mutable bool allocated;
     std::string name;
-    std::vector<int> table;
+    // Owned by the table, or a view of a buffer kept alive by its owner
+    std::shared_ptr<int[]> cells;
     int width, height;
+    Format format;
+
+    struct PixelFormat {
+        GLint internalFormat;
+        GLenum format;
+        GLenum type;
+    };
 
-    int index(int row, int col) const {
-        return row * width + col;
+    PixelFormat pixelFormat() const {
+        switch (format) {
+            case Format::R32I:
+                return {GL_R32I, GL_RED_INTEGER, GL_INT};
+            case Format::R32UI:
+                return {GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT};
+            case Format::R32F:
+                return {GL_R32F, GL_RED, GL_FLOAT};
+            case Format::RGBA8:
+            default:
+                return {GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE};
+        }
+    }
+
+    size_t index(int row, int col) const {
+        return static_cast<size_t>(row) * width + col;
+    }
+
+    static size_t cellCount(int width, int height) {
+        return static_cast<size_t>(width) * height;
     }
 
 public:
     typedef std::shared_ptr<Table> Ptr;
 
-    Table(const std::string_view & name, int width, int height)
-        : table(width * height, 0), name(name), width(width), height(height) {
-        glGenTextures(1, &texId);
-    }
+    /**
+     * Create a table with every cell set to 0.
+     */
+    Table(const std::string_view & name, int width, int height, Format format = Format::RGBA8)
+        : Table(name, std::shared_ptr<int[]>(new int[cellCount(width, height)]()), width, height,
+                format) {}
+
+    /**
+     * Create a table on width * height cells without copying them.
+     *
+     * @param cells the cells, shared with the caller
+     */
+    Table(const std::string_view & name,
+          std::shared_ptr<int[]> cells,
+          int width,
+          int height,
+          Format format = Format::RGBA8)
+        : texId(0),
+          allocated(false),
+          name(name),
+          cells(std::move(cells)),
+          width(width),
+          height(height),
+          format(format) {}
+
+    Table(const Table &) = delete;
+    Table & operator=(const Table &) = delete;
 
     ~Table() {
-        glDeleteTextures(1, &texId);
+        if (texId)
+            GLState::deleteTexture(texId);
     }
 
+    /**
+     * Get the OpenGL texture id, creating the texture on first use so tables
+     * that never leave the host do not need a context.
+     */
     GLuint getTexId() const {
+        if (!texId)
+            glGenTextures(1, &texId);
         return texId;
     }
 
+    const std::string & getName() const {
+        return name;
+    }
+
     const int * data() const {
-        return table.data();
+        return cells.get();
+    }
+
+    int * data() {
+        return cells.get();
     }
 
     int getWidth() const {
@@ -48,42 +137,296 @@ public:
         return height;
     }
 
+    Format getFormat() const {
+        return format;
+    }
+
     void setCell(int val, int row, int col) {
-        table[index(row, col)] = val;
+        cells[index(row, col)] = val;
     }
 
     int getCell(int row, int col) const {
-        return table[index(row, col)];
+        return cells[index(row, col)];
     }
 
-    void loadTable(const std::vector<int> & table) {
-        this->table = table;
-        glBindTexture(GL_TEXTURE_2D, texId);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
-                     GL_UNSIGNED_BYTE, table.data());
+    /**
+     * Set the cell of an R32F table.
+     */
+    void setFloat(float val, int row, int col) {
+        std::memcpy(&cells[index(row, col)], &val, sizeof(val));
+    }
+
+    /**
+     * Get the cell of an R32F table.
+     */
+    float getFloat(int row, int col) const {
+        float val;
+        std::memcpy(&val, &cells[index(row, col)], sizeof(val));
+        return val;
+    }
+
+    /**
+     * Copy the cells from table, which holds width * height cells.
+     *
+     * @return false, leaving the cells unchanged, if table has another size
+     */
+    bool setTable(const std::vector<int> & table) {
+        if (!checkSize(name, table, width, height))
+            return false;
+        std::copy_n(table.begin(), table.size(), cells.get());
+        return true;
+    }
+
+    /**
+     * Take the cells of table without copying them, table holds
+     * width * height cells.
+     *
+     * @return false, leaving the cells unchanged, if table has another size
+     */
+    bool setTable(std::vector<int> && table) {
+        if (!checkSize(name, table, width, height))
+            return false;
+        auto owner = std::make_shared<std::vector<int>>(std::move(table));
+        cells = std::shared_ptr<int[]>(owner, owner->data());
+        return true;
+    }
+
+    /**
+     * Set the cells as setTable does and upload them.
+     *
+     * @return false, uploading nothing, if table has another size
+     */
+    bool loadTable(const std::vector<int> & table) {
+        if (!setTable(table))
+            return false;
+        upload();
+        return true;
+    }
+
+    bool loadTable(std::vector<int> && table) {
+        if (!setTable(std::move(table)))
+            return false;
+        upload();
+        return true;
+    }
+
+    void upload() const {
+        TRACE_GL_SCOPE("upload");
+        texImage(cells.get());
+    }
+
+    /**
+     * Allocate texture storage without uploading the host data, eg. for a
+     * table that will be rendered to. Does nothing once allocated.
+     */
+    void allocate() const {
+        if (!allocated)
+            texImage(nullptr);
+    }
+
+private:
+    /**
+     * Does table hold width * height cells, the mismatch is printed if not.
+     */
+    static bool checkSize(const std::string_view & name,
+                          const std::vector<int> & table,
+                          int width,
+                          int height) {
+        if (table.size() == cellCount(width, height))
+            return true;
+        fmt::print(stderr, "Table {} has {} cells, expected {}x{}\n", name, table.size(), width,
+                   height);
+        return false;
+    }
+
+    void texImage(const void * pixels) const {
+        auto pf = pixelFormat();
+        GLState::bindTexture(getTexId());
+        if (allocated) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, pf.format, pf.type, pixels);
+            return;
+        }
+
+        glTexImage2D(GL_TEXTURE_2D, 0, pf.internalFormat, width, height, 0,
+                     pf.format, pf.type, pixels);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        allocated = true;
+    }
+
+public:
+    /**
+     * Copy the rows x cols region starting at row, col into out, packed with
+     * a stride of cols. Cells that fall outside of this table are set to 0.
+     */
+    void readRegion(int row, int col, int rows, int cols, int * out) const {
+        int copyCols = std::max(0, std::min(cols, width - col));
+        for (int r = 0; r < rows; r++, out += cols) {
+            if (row + r < height && copyCols > 0) {
+                std::copy_n(&cells[index(row + r, col)], copyCols, out);
+                std::fill(out + copyCols, out + cols, 0);
+            }
+            else {
+                std::fill(out, out + cols, 0);
+            }
+        }
+    }
+
+    /**
+     * Copy rows x cols cells from in, packed with a stride of cols, into this
+     * table starting at row, col. Cells that fall outside of this table are
+     * dropped.
+     */
+    void writeRegion(int row, int col, int rows, int cols, const int * in) {
+        int copyRows = std::min(rows, height - row);
+        int copyCols = std::min(cols, width - col);
+        for (int r = 0; r < copyRows; r++, in += cols) {
+            std::copy_n(in, copyCols, &cells[index(row + r, col)]);
+        }
+    }
+
+    /**
+     * Fill this table with the region of src starting at row, col. Cells
+     * that fall outside of src are set to 0.
+     */
+    void copyFrom(const Table & src, int row, int col) {
+        src.readRegion(row, col, height, width, cells.get());
+    }
+
+    /**
+     * Write this table into dst starting at row, col. Cells that fall
+     * outside of dst are dropped.
+     */
+    void copyTo(Table & dst, int row, int col) const {
+        dst.writeRegion(row, col, height, width, cells.get());
     }
 
     void readFromPixels() {
-        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, table.data());
+        TRACE_GL_SCOPE("readback");
+        auto pf = pixelFormat();
+        glReadPixels(0, 0, width, height, pf.format, pf.type, cells.get());
+    }
+
+    /**
+     * Upload the texture from offset 0 of the bound GL_PIXEL_UNPACK_BUFFER
+     * instead of the host data.
+     */
+    void uploadFromBuffer() const {
+        TRACE_GL_SCOPE("upload");
+        texImage(nullptr);
+    }
+
+    /**
+     * Start reading the framebuffer into offset 0 of the bound
+     * GL_PIXEL_PACK_BUFFER instead of the host data.
+     */
+    void readToBuffer() const {
+        TRACE_GL_SCOPE("readback");
+        auto pf = pixelFormat();
+        glReadPixels(0, 0, width, height, pf.format, pf.type, nullptr);
+    }
+
+    /**
+     * Bind the texture to unit index without touching any uniform.
+     */
+    void bindTexture(int index) const {
+        GLState::bindTexture(index, getTexId());
+    }
+
+    /**
+     * Bind the texture to unit index and point the sampler uniform at it.
+     *
+     * @param sampler the uniform name, which need not be the table name
+     */
+    void bind(int index, const Shader::Ptr & shader, const std::string_view & sampler) const {
+        bindTexture(index);
+        shader->setInt(sampler, index);
     }
 
-    void bind(int index, const Shader::Ptr & shader) const {
-        glActiveTexture(GL_TEXTURE0 + index);
-        glBindTexture(GL_TEXTURE_2D, texId);
-        shader->setInt(name, index);
+    /**
+     * Create a table whose cells are not initialized, for callers that set
+     * every cell right away.
+     */
+    static Table::Ptr uninitialized(const std::string_view & name,
+                                    int width,
+                                    int height,
+                                    Format format = Format::RGBA8) {
+        return std::make_shared<Table>(name, std::shared_ptr<int[]>(new int[cellCount(width, height)]),
+                                       width, height, format);
     }
 
+    /**
+     * Create a table with a copy of table and upload it.
+     *
+     * @return the table or nullptr if table does not hold width * height cells
+     */
     static Table::Ptr fromTable(const std::string_view & name,
                                 const std::vector<int> & table,
                                 int width,
-                                int height) {
-        auto buff = std::make_shared<Table>(name, width, height);
-        if (buff) {
-            buff->loadTable(table);
-        }
+                                int height,
+                                Format format = Format::RGBA8) {
+        if (!checkSize(name, table, width, height))
+            return nullptr;
+        auto buff = uninitialized(name, width, height, format);
+        buff->loadTable(table);
         return buff;
     }
+
+    /**
+     * Create a table that takes the cells of table without copying them and
+     * upload it.
+     *
+     * @return the table or nullptr if table does not hold width * height cells
+     */
+    static Table::Ptr fromTable(const std::string_view & name,
+                                std::vector<int> && table,
+                                int width,
+                                int height,
+                                Format format = Format::RGBA8) {
+        if (!checkSize(name, table, width, height))
+            return nullptr;
+        auto owner = std::make_shared<std::vector<int>>(std::move(table));
+        auto buff = fromBuffer(name, owner->data(), owner, width, height, format);
+        buff->upload();
+        return buff;
+    }
+
+    /**
+     * Create a table viewing width * height cells of a caller buffer, without
+     * copying or uploading them. Writes to the table write to the buffer.
+     *
+     * @param data the first cell
+     * @param owner keeps data alive as long as the table, may be nullptr if
+     *        the caller does
+     */
+    static Table::Ptr fromBuffer(const std::string_view & name,
+                                 int * data,
+                                 const std::shared_ptr<const void> & owner,
+                                 int width,
+                                 int height,
+                                 Format format = Format::RGBA8) {
+        // Aliasing an empty owner gives a pointer that owns nothing
+        return std::make_shared<Table>(name, std::shared_ptr<int[]>(owner, data), width, height,
+                                       format);
+    }
 };
+
+/**
+ * Find the Table::Format with the given name, eg. r32i or rgba8.
+ *
+ * @param name the lower case format name
+ *
+ * @return the format or std::nullopt if name is not a format
+ */
+inline std::optional<Table::Format> formatFromName(const std::string_view & name) {
+    if (name == "rgba8")
+        return Table::Format::RGBA8;
+    if (name == "r32i")
+        return Table::Format::R32I;
+    if (name == "r32ui")
+        return Table::Format::R32UI;
+    if (name == "r32f")
+        return Table::Format::R32F;
+    return std::nullopt;
+}
@@ -0,0 +1,12 @@
+# Run APP with ARGS, a space separated list, and compare what it prints to
+# the file EXPECTED: cmake -DAPP=... -DARGS=... -DEXPECTED=... -P check_output.cmake
+separate_arguments(args UNIX_COMMAND "${ARGS}")
+execute_process(COMMAND ${APP} ${args} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${APP} ${ARGS} exited with ${result}")
+endif()
+
+file(READ ${EXPECTED} expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "${APP} ${ARGS} printed\n${output}expected\n${expected}")
+endif()
@@ -0,0 +1,27 @@
+# Run APP with ARGS and with REFERENCE, space separated lists, and check that
+# both print the same. ENV, a NAME=VALUE pair, is set for ARGS only:
+# cmake -DAPP=... -DARGS=... -DREFERENCE=... [-DENV=...] -P compare_outputs.cmake
+function(run_app args_text env_text out_var)
+    separate_arguments(args UNIX_COMMAND "${args_text}")
+    if(env_text)
+        string(REPLACE "=" ";" env "${env_text}")
+        list(GET env 0 name)
+        list(GET env 1 value)
+        set(ENV{${name}} "${value}")
+    endif()
+    execute_process(COMMAND ${APP} ${args} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+    if(env_text)
+        unset(ENV{${name}})
+    endif()
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${env_text} ${APP} ${args_text} exited with ${result}")
+    endif()
+    set(${out_var} "${output}" PARENT_SCOPE)
+endfunction()
+
+run_app("${ARGS}" "${ENV}" output)
+run_app("${REFERENCE}" "" expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR
+            "${ENV} ${APP} ${ARGS} printed\n${output}${APP} ${REFERENCE} printed\n${expected}")
+endif()
@@ -0,0 +1,17 @@
+# Write a 1500x1300 csv table to OUTPUT for the reduction checks. It is
+# larger than the 1024x1024 surface of egl so the edge tiles are partial,
+# holds INT_MIN and INT_MAX so integer sums carry, and every fourth row is
+# positive so reading past the edge shows up as a 0 minimum.
+set(a "-2147483648, 2147483647, 2147483647, -1, 0, 1, 123456789, -987654321, 2147483647, 5, ")
+set(b "2147483647, -7, 0, 0, -2147483648, 65536, 16777216, -16777217, 255, 256, ")
+set(c "0, 0, 0, 0, 0, -2147483648, -2147483648, 0, 0, 1, ")
+set(d "1, 2147483647, 3, 1000000000, 7, 2147483646, 9, 11, 2147483647, 13, ")
+
+set(rows "")
+foreach(pattern a b c d)
+    string(REPEAT "${${pattern}}" 150 row)
+    string(REGEX REPLACE ", $" "\n" row "${row}")
+    string(APPEND rows "${row}")
+endforeach()
+string(REPEAT "${rows}" 325 table)
+file(WRITE ${OUTPUT} "${table}")
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <GLES3/gl3.h>
+
+#include <memory>
+
+/**
+ * Manages a single buffer that transform feedback captures vertex shader
+ * outputs into.
+ */
+class FeedbackBuffer {
+    GLuint tfb;
+    GLsizeiptr size;
+
+public:
+    using Ptr = std::shared_ptr<FeedbackBuffer>;
+
+    /**
+     * Create a new FeedbackBuffer and allocate its storage.
+     *
+     * @param size the size in bytes
+     */
+    explicit FeedbackBuffer(GLsizeiptr size) : tfb(0), size(size) {
+        glGenBuffers(1, &tfb);
+        bind();
+        glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    }
+
+    FeedbackBuffer(const FeedbackBuffer &) = delete;
+    FeedbackBuffer & operator=(const FeedbackBuffer &) = delete;
+
+    ~FeedbackBuffer() {
+        glDeleteBuffers(1, &tfb);
+    }
+
+    GLsizeiptr getSize() const {
+        return size;
+    }
+
+    void bind() const {
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, tfb);
+    }
+
+    /**
+     * Bind to the transform feedback binding index, the interleaved
+     * varyings are written to index 0.
+     */
+    void bindBase(GLuint index) const {
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, index, tfb);
+    }
+
+    /**
+     * Bind and map the first bytes of the buffer for reading, after
+     * glEndTransformFeedback.
+     *
+     * @return the mapped memory or nullptr on failure
+     */
+    const void * mapRead(GLsizeiptr bytes) const {
+        bind();
+        return glMapBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    }
+
+    /**
+     * Unmap the buffer, it stays bound.
+     */
+    void unmap() const {
+        glUnmapBuffer(GL_TRANSFORM_FEEDBACK_BUFFER);
+    }
+};
@@ -0,0 +1,249 @@
+#include "tile.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <string>
+
+#include "framebuffer.hpp"
+#include "pbo.hpp"
+#include "trace.hpp"
+
+std::vector<Tile> splitTiles(int width, int height, int tileWidth, int tileHeight) {
+    std::vector<Tile> tiles;
+    for (int row = 0; row < height; row += tileHeight) {
+        for (int col = 0; col < width; col += tileWidth) {
+            tiles.push_back({row, col, std::min(tileWidth, width - col),
+                             std::min(tileHeight, height - row)});
+        }
+    }
+    return tiles;
+}
+
+Table::Ptr renderTiled(const Context & context,
+                       RenderCache & cache,
+                       const Shader::Ptr & shader,
+                       const std::vector<Table::Ptr> & inputs,
+                       const std::vector<std::string> & samplers,
+                       const std::string_view & name) {
+    if (samplers.size() != inputs.size()) {
+        fmt::print(stderr, "renderTiled {} samplers for {} inputs\n", samplers.size(),
+                   inputs.size());
+        return nullptr;
+    }
+
+    // The samplers name the inputs, so two tables with the same name or a
+    // name other than the sampler are still bound in order
+    Pass pass {shader, samplers, std::string(name), samplers};
+    return renderPasses(context, cache, {pass}, inputs, samplers);
+}
+
+Table::Ptr renderPasses(const Context & context,
+                        RenderCache & cache,
+                        const std::vector<Pass> & passes,
+                        const std::vector<Table::Ptr> & inputs,
+                        const std::vector<std::string> & names) {
+    if (passes.empty() || inputs.empty())
+        return nullptr;
+
+    auto nameOf = [&](size_t i) -> const std::string & {
+        return names.empty() ? inputs[i]->getName() : names[i];
+    };
+
+    int width = inputs[0]->getWidth();
+    int height = inputs[0]->getHeight();
+    auto format = inputs[0]->getFormat();
+
+    for (auto & input : inputs) {
+        if (input->getWidth() != width || input->getHeight() != height) {
+            fmt::print(stderr, "renderPasses input size mismatch {}x{} != {}x{}\n",
+                       input->getWidth(), input->getHeight(), width, height);
+            return nullptr;
+        }
+        if (input->getFormat() != format) {
+            fmt::print(stderr, "renderPasses input {} format does not match {}\n",
+                       input->getName(), inputs[0]->getName());
+            return nullptr;
+        }
+    }
+
+    // Resolve every sampler to an input table or the latest earlier pass
+    // with that output name, and find the last pass reading each output.
+    struct Source {
+        bool isInput;
+        size_t index;
+    };
+    std::vector<std::vector<Source>> sources(passes.size());
+    std::vector<int> lastUse(passes.size(), -1);
+    std::vector<bool> inputUsed(inputs.size(), false);
+
+    for (size_t p = 0; p < passes.size(); p++) {
+        for (auto & name : passes[p].inputs) {
+            int producer = -1;
+            for (int q = p - 1; q >= 0; q--) {
+                if (passes[q].output == name) {
+                    producer = q;
+                    break;
+                }
+            }
+
+            if (producer >= 0) {
+                sources[p].push_back({false, static_cast<size_t>(producer)});
+                lastUse[producer] = p;
+                continue;
+            }
+
+            size_t index = 0;
+            while (index < inputs.size() && nameOf(index) != name)
+                index++;
+            if (index == inputs.size()) {
+                fmt::print(stderr, "renderPasses no table named {} for pass {}\n", name,
+                           passes[p].output);
+                return nullptr;
+            }
+            sources[p].push_back({true, index});
+            inputUsed[index] = true;
+        }
+    }
+
+    // Give each pass a render target, reusing the target of a pass once its
+    // output is no longer read. A chain of passes ping-pongs between two.
+    std::vector<size_t> targetOf(passes.size());
+    std::vector<size_t> freeTargets;
+    size_t numTargets = 0;
+    for (size_t p = 0; p < passes.size(); p++) {
+        if (freeTargets.empty()) {
+            targetOf[p] = numTargets++;
+        }
+        else {
+            targetOf[p] = freeTargets.back();
+            freeTargets.pop_back();
+        }
+
+        for (auto & source : sources[p]) {
+            if (!source.isInput && lastUse[source.index] == static_cast<int>(p))
+                freeTargets.push_back(targetOf[source.index]);
+        }
+        if (lastUse[p] < 0 && p + 1 < passes.size())
+            freeTargets.push_back(targetOf[p]);
+    }
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    int tileWidth = std::min({width, context.getWidth(), maxTextureSize});
+    int tileHeight = std::min({height, context.getHeight(), maxTextureSize});
+
+    // Two sets of tile textures and pixel buffers, so the host fills and
+    // reads one tile while the GPU uploads, draws and reads back the other.
+    GLsizeiptr tileBytes = static_cast<GLsizeiptr>(tileWidth) * tileHeight * sizeof(int);
+    std::vector<Table::Ptr> tileInputs[2];
+    std::vector<PixelBuffer::Ptr> unpackBuffers[2];
+    PixelBuffer::Ptr packBuffers[2];
+    for (int slot = 0; slot < 2; slot++) {
+        for (size_t i = 0; i < inputs.size(); i++) {
+            tileInputs[slot].push_back(cache.texture(tileWidth, tileHeight, format));
+            unpackBuffers[slot].push_back(cache.buffer(GL_PIXEL_UNPACK_BUFFER, tileBytes));
+        }
+        packBuffers[slot] = cache.buffer(GL_PIXEL_PACK_BUFFER, tileBytes);
+    }
+
+    auto & name = passes.back().output;
+    auto output = Table::uninitialized(name, width, height, format);
+
+    // Pass outputs stay on the GPU in the target textures, integer and float
+    // formats can not be drawn to the pbuffer anyway.
+    auto fbo = cache.framebuffer();
+    std::vector<Table::Ptr> targets;
+    for (size_t t = 0; t < numTargets; t++) {
+        auto target = cache.texture(tileWidth, tileHeight, format);
+        if (!fbo->attach(*target)) {
+            fmt::print(stderr, "renderPasses framebuffer incomplete for {}\n", name);
+            fbo->unbind();
+            return nullptr;
+        }
+        targets.push_back(target);
+    }
+
+    auto & vbo = cache.getQuad();
+
+    GLState::viewport(0, 0, tileWidth, tileHeight);
+
+    // Texture units never change between tiles, so samplers are set once
+    for (auto & pass : passes) {
+        pass.shader->bind();
+        pass.shader->setInt("width", tileWidth);
+        pass.shader->setInt("height", tileHeight);
+        for (size_t i = 0; i < pass.inputs.size(); i++) {
+            pass.shader->setInt(pass.samplers.empty() ? pass.inputs[i] : pass.samplers[i], i);
+        }
+    }
+
+    auto tiles = splitTiles(width, height, tileWidth, tileHeight);
+
+    // Copy the readback of tiles[t] into the output once the GPU is done
+    auto collect = [&](size_t t) {
+        TRACE_SCOPE("collect");
+        auto & pbo = packBuffers[t % 2];
+        pbo->wait();
+        auto cells = static_cast<const int *>(pbo->map(GL_MAP_READ_BIT));
+        if (cells)
+            output->writeRegion(tiles[t].row, tiles[t].col, tileHeight, tileWidth, cells);
+        pbo->unmap();
+        pbo->unbind();
+    };
+
+    for (size_t t = 0; t < tiles.size(); t++) {
+        auto & tile = tiles[t];
+        int slot = t % 2;
+
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if (!inputUsed[i])
+                continue;
+
+            TRACE_SCOPE("fill");
+            auto & pbo = unpackBuffers[slot][i];
+            pbo->wait();
+            auto cells = static_cast<int *>(
+                pbo->map(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+            if (cells)
+                inputs[i]->readRegion(tile.row, tile.col, tileHeight, tileWidth, cells);
+            pbo->unmap();
+            tileInputs[slot][i]->uploadFromBuffer();
+            pbo->fenceSync();
+            pbo->unbind();
+        }
+
+        for (size_t p = 0; p < passes.size(); p++) {
+            fbo->attach(*targets[targetOf[p]]);
+
+            passes[p].shader->bind();
+
+            for (size_t i = 0; i < sources[p].size(); i++) {
+                auto & source = sources[p][i];
+                if (source.isInput)
+                    tileInputs[slot][source.index]->bindTexture(i);
+                else
+                    targets[targetOf[source.index]]->bindTexture(i);
+            }
+
+            vbo.draw();
+        }
+
+        // The last pass target is still attached
+        packBuffers[slot]->bind();
+        targets[targetOf.back()]->readToBuffer();
+        packBuffers[slot]->fenceSync();
+        packBuffers[slot]->unbind();
+
+        if (t > 0)
+            collect(t - 1);
+    }
+
+    if (!tiles.empty())
+        collect(tiles.size() - 1);
+
+    fbo->unbind();
+
+    return output;
+}
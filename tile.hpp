@@ -0,0 +1,106 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Shader.hpp"
+#include "context.hpp"
+#include "render_cache.hpp"
+#include "table.hpp"
+
+/**
+ * A rectangular region of a larger table.
+ */
+struct Tile {
+    /// The first row covered by this tile
+    int row;
+    /// The first column covered by this tile
+    int col;
+    /// The number of columns in this tile
+    int width;
+    /// The number of rows in this tile
+    int height;
+};
+
+/**
+ * One draw of a multi pass render.
+ */
+struct Pass {
+    /// The shader to draw with
+    Shader::Ptr shader;
+    /// The tables sampled by the shader
+    std::vector<std::string> inputs;
+    /// The name of the table written, which later passes can sample
+    std::string output;
+    /// The sampler uniform of each input, the input name if empty
+    std::vector<std::string> samplers;
+};
+
+/**
+ * Split a width x height table into tiles no larger than tileWidth x
+ * tileHeight. Tiles along the right and top edge may be smaller.
+ *
+ * @param width the table width
+ * @param height the table height
+ * @param tileWidth the maximum tile width
+ * @param tileHeight the maximum tile height
+ *
+ * @return the tiles in row major order
+ */
+std::vector<Tile> splitTiles(int width, int height, int tileWidth, int tileHeight);
+
+/**
+ * Run shader over inputs one tile at a time and stitch the results into a
+ * new table.
+ *
+ * Tiles are limited by the context surface and GL_MAX_TEXTURE_SIZE, so the
+ * inputs may be larger than either. All inputs must have the same size and
+ * format, the output has the same format. Each tile of the inputs is
+ * uploaded as its own texture, so the shader addresses cells within the tile
+ * and receives the tile size in the width and height uniforms.
+ *
+ * Tiles are uploaded and read back through double buffered pixel buffer
+ * objects, so copying tile N on the host overlaps the GPU work of tile N+1.
+ *
+ * @param context the current context
+ * @param cache the quad, tile textures and pixel buffers to reuse
+ * @param shader the shader to draw with
+ * @param inputs the tables to bind, in texture unit order
+ * @param samplers the sampler uniform of each input, inputs are bound by
+ *        position so their table names do not matter
+ * @param name the name of the output table
+ *
+ * @return the output table or nullptr if the inputs are empty or mismatched
+ */
+Table::Ptr renderTiled(const Context & context,
+                       RenderCache & cache,
+                       const Shader::Ptr & shader,
+                       const std::vector<Table::Ptr> & inputs,
+                       const std::vector<std::string> & samplers,
+                       const std::string_view & name);
+
+/**
+ * Run a sequence of passes over inputs one tile at a time and read back only
+ * the output of the last pass.
+ *
+ * A pass samples input tables or the output of earlier passes by name, the
+ * latest earlier pass wins over an input of the same name. Pass outputs are
+ * rendered into tile textures that stay on the GPU, a texture is reused once
+ * no later pass reads it so a chain of passes ping-pongs between two.
+ * Tiling and transfers work as in renderTiled.
+ *
+ * @param context the current context
+ * @param cache the quad, tile textures and pixel buffers to reuse
+ * @param passes the passes in order
+ * @param inputs the tables the passes may sample, all the same size and format
+ * @param names the name the passes use for each input, the table names if
+ *        empty
+ *
+ * @return the output of the last pass or nullptr on failure
+ */
+Table::Ptr renderPasses(const Context & context,
+                        RenderCache & cache,
+                        const std::vector<Pass> & passes,
+                        const std::vector<Table::Ptr> & inputs,
+                        const std::vector<std::string> & names = {});
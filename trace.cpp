@@ -0,0 +1,273 @@
+#include "trace.hpp"
+
+#ifdef EGL_MATH_TRACE
+
+#include <EGL/egl.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+#ifndef GL_QUERY_COUNTER_BITS
+#define GL_QUERY_COUNTER_BITS 0x8864
+#endif
+
+namespace trace {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Event times are microseconds since the program started
+const Clock::time_point epoch = Clock::now();
+
+double micros(Clock::time_point time) {
+    return std::chrono::duration<double, std::micro>(time - epoch).count();
+}
+
+struct Event {
+    std::string name;
+    std::string job;
+    bool gpu;
+    int tid;
+    double start;
+    double duration;
+};
+
+// A GL_TIME_ELAPSED query still in flight
+struct Pending {
+    const char * name;
+    double start;
+    GLuint query;
+};
+
+std::string escape(const std::string_view & text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if (static_cast<unsigned char>(c) < 0x20)
+            out += fmt::format("\\u{:04x}", static_cast<int>(c));
+        else
+            out += c;
+    }
+    return out;
+}
+
+/**
+ * Every finished event of every thread, written as a Chrome trace at exit
+ * when $EGL_MATH_TRACE_FILE is set.
+ */
+class Recorder {
+    std::mutex mutex;
+    std::vector<Event> events;
+
+public:
+    void add(std::vector<Event> & finished) {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.insert(events.end(), finished.begin(), finished.end());
+        finished.clear();
+    }
+
+    ~Recorder() {
+        auto path = std::getenv("EGL_MATH_TRACE_FILE");
+        if (!path || !*path)
+            return;
+
+        auto file = std::fopen(path, "w");
+        if (!file) {
+            fmt::print(stderr, "trace: could not open {}\n", path);
+            return;
+        }
+
+        // Host events in process 0, GPU events in process 1 on the same
+        // thread as the host scope that issued them
+        fmt::print(file, "{{\"traceEvents\": [\n"
+                         "{{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, "
+                         "\"args\": {{\"name\": \"host\"}}}},\n"
+                         "{{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+                         "\"args\": {{\"name\": \"gpu\"}}}}");
+        for (auto & event : events) {
+            fmt::print(file,
+                       ",\n{{\"name\": \"{}\", \"cat\": \"{}\", \"ph\": \"X\", "
+                       "\"ts\": {:.3f}, \"dur\": {:.3f}, \"pid\": {}, \"tid\": {}, "
+                       "\"args\": {{\"job\": \"{}\"}}}}",
+                       escape(event.name), event.gpu ? "gpu" : "host", event.start,
+                       event.duration, event.gpu ? 1 : 0, event.tid, escape(event.job));
+        }
+        fmt::print(file, "\n]}}\n");
+        std::fclose(file);
+    }
+};
+
+Recorder & recorder() {
+    static Recorder recorder;
+    return recorder;
+}
+
+struct ThreadState {
+    int tid;
+    /// The current job, empty outside of TRACE_JOB
+    std::string job;
+    std::vector<Event> events;
+    std::vector<Pending> pending;
+    /// The context timer query support was last checked for
+    EGLContext checked = EGL_NO_CONTEXT;
+    bool timerQueries = false;
+
+    ThreadState() {
+        static std::atomic<int> threads {0};
+        tid = threads++;
+    }
+};
+
+ThreadState & state() {
+    thread_local ThreadState state;
+    return state;
+}
+
+using GetQueryObjectui64v = void (*)(GLuint, GLenum, GLuint64 *);
+
+GetQueryObjectui64v getQueryObjectui64v() {
+    static auto fn =
+        reinterpret_cast<GetQueryObjectui64v>(eglGetProcAddress("glGetQueryObjectui64v"));
+    return fn;
+}
+
+/**
+ * Can the current context time commands with GL_TIME_ELAPSED, checked once
+ * per context.
+ */
+bool timerQueries(ThreadState & thread) {
+    auto context = eglGetCurrentContext();
+    if (context == EGL_NO_CONTEXT)
+        return false;
+
+    if (context != thread.checked) {
+        thread.checked = context;
+        GLint bits = 0;
+        if (getQueryObjectui64v()) {
+            glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &bits);
+            while (glGetError() != GL_NO_ERROR) {
+            }
+        }
+        thread.timerQueries = bits > 0;
+    }
+    return thread.timerQueries;
+}
+
+/**
+ * Wait for the queries of this thread and turn them into events.
+ */
+void resolve(ThreadState & thread) {
+    for (auto & pending : thread.pending) {
+        GLuint64 nanos = 0;
+        getQueryObjectui64v()(pending.query, GL_QUERY_RESULT, &nanos);
+        glDeleteQueries(1, &pending.query);
+        thread.events.push_back(
+            {pending.name, thread.job, true, thread.tid, pending.start, nanos / 1e3});
+    }
+    thread.pending.clear();
+}
+
+/**
+ * Print the count and total host and GPU time of each stage of the events
+ * of the current job.
+ */
+void summarize(const ThreadState & thread) {
+    struct Stage {
+        std::string name;
+        size_t count = 0;
+        double host = 0;
+        double gpu = 0;
+        bool timed = false;
+    };
+    std::vector<Stage> stages;
+    for (auto & event : thread.events) {
+        auto it = std::find_if(stages.begin(), stages.end(),
+                               [&](auto & stage) { return stage.name == event.name; });
+        if (it == stages.end())
+            it = stages.insert(stages.end(), Stage {event.name});
+
+        if (event.gpu) {
+            it->gpu += event.duration;
+            it->timed = true;
+        }
+        else {
+            it->host += event.duration;
+            it->count++;
+        }
+    }
+
+    std::string out = fmt::format("trace {}\n  {:<12} {:>6} {:>12} {:>12}\n", thread.job,
+                                  "stage", "count", "host ms", "gpu ms");
+    for (auto & stage : stages) {
+        out += fmt::format("  {:<12} {:>6} {:>12.3f} ", stage.name, stage.count,
+                           stage.host / 1e3);
+        out += stage.timed ? fmt::format("{:>12.3f}\n", stage.gpu / 1e3)
+                           : fmt::format("{:>12}\n", "-");
+    }
+    fmt::print(stderr, "{}", out);
+}
+
+} // namespace
+
+Scope::Scope(const char * name) : name(name), start(Clock::now()) {}
+
+Scope::~Scope() {
+    auto end = Clock::now();
+    auto & thread = state();
+    thread.events.push_back({name, thread.job, false, thread.tid, micros(start),
+                             std::chrono::duration<double, std::micro>(end - start).count()});
+
+    // Outside of a job nothing collects the events later
+    if (thread.job.empty())
+        recorder().add(thread.events);
+}
+
+GLScope::GLScope(const char * name) : Scope(name), query(0) {
+    if (!timerQueries(state()))
+        return;
+
+    glGenQueries(1, &query);
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+GLScope::~GLScope() {
+    if (!query)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    auto & thread = state();
+    thread.pending.push_back({name, micros(start), query});
+    if (thread.job.empty())
+        resolve(thread);
+}
+
+Job::Job(const std::string_view & name) : start(Clock::now()) {
+    state().job = name;
+}
+
+Job::~Job() {
+    auto end = Clock::now();
+    auto & thread = state();
+    resolve(thread);
+    thread.events.push_back({"job", thread.job, false, thread.tid, micros(start),
+                             std::chrono::duration<double, std::micro>(end - start).count()});
+    summarize(thread);
+    recorder().add(thread.events);
+    thread.job.clear();
+}
+
+} // namespace trace
+
+#endif
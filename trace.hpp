@@ -0,0 +1,86 @@
+#pragma once
+
+/**
+ * Opt in timing of the stages of a job, built with -DEGL_MATH_TRACE=ON.
+ *
+ * TRACE_SCOPE times the rest of the enclosing block on the host,
+ * TRACE_GL_SCOPE also times the GL commands issued in it on the GPU with a
+ * GL_TIME_ELAPSED query when the context supports them. GL scopes must not
+ * nest. TRACE_JOB groups the events of the thread under a job name until the
+ * end of the block, then resolves the queries and prints a summary of the
+ * job to stderr. When $EGL_MATH_TRACE_FILE is set every event is written to
+ * it as Chrome trace_event JSON at exit, load it in chrome://tracing or
+ * Perfetto.
+ *
+ * Without EGL_MATH_TRACE the macros expand to nothing.
+ */
+
+#ifdef EGL_MATH_TRACE
+
+#include <GLES3/gl3.h>
+
+#include <chrono>
+#include <string_view>
+
+namespace trace {
+
+/**
+ * Times its lifetime on the host.
+ */
+class Scope {
+protected:
+    const char * name;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit Scope(const char * name);
+
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope & operator=(const Scope &) = delete;
+};
+
+/**
+ * Times its lifetime on the host and the GL commands issued during it on
+ * the GPU. A context must be current.
+ */
+class GLScope : public Scope {
+    GLuint query;
+
+public:
+    explicit GLScope(const char * name);
+
+    ~GLScope();
+};
+
+/**
+ * Groups the events of this thread under a job until destroyed.
+ */
+class Job {
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit Job(const std::string_view & name);
+
+    ~Job();
+
+    Job(const Job &) = delete;
+    Job & operator=(const Job &) = delete;
+};
+
+} // namespace trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_GL_SCOPE(name) trace::GLScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_JOB(name) trace::Job TRACE_CONCAT(traceJob, __LINE__)(name)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_GL_SCOPE(name)
+#define TRACE_JOB(name)
+
+#endif
@@ -1,5 +1,8 @@
 #include "vbo.hpp"
 
+#include "gl_state.hpp"
+#include "trace.hpp"
+
 Vertex::Vertex() : pos(0), norm(0), uv(0) {}
 
 Vertex::Vertex(const glm::vec3 & pos, const glm::vec3 & norm, const glm::vec2 & uv)
@@ -63,24 +66,40 @@ void draw_quad(const glm::vec2 & pos, const glm::vec2 & size) {
     draw_array(vertices, GL_TRIANGLES);
 }
 
-VBO::VBO(VBO::Mode mode, VBO::Usage usage)
-    : mode(mode), usage(usage), vbo(0), nPoints(0) {
+std::vector<Vertex> fullscreen_quad() {
+    return {
+        Vertex({1, -1, 0}, {0, 0, 0}, {1, 0}),
+        Vertex({-1, -1, 0}, {0, 0, 0}, {0, 0}),
+        Vertex({-1, 1, 0}, {0, 0, 0}, {0, 1}),
+
+        Vertex({1, -1, 0}, {0, 0, 0}, {1, 0}),
+        Vertex({-1, 1, 0}, {0, 0, 0}, {0, 1}),
+        Vertex({1, 1, 0}, {0, 0, 0}, {1, 1}),
+    };
+}
+
+std::vector<VertexAttribute> vertex_layout() {
+    return {
+        {3, GL_FLOAT, sizeof(Vertex), 0},
+        {3, GL_FLOAT, sizeof(Vertex), 3 * sizeof(float)},
+        {2, GL_FLOAT, sizeof(Vertex), 6 * sizeof(float)},
+    };
+}
+
+VBO::VBO(VBO::Mode mode, VBO::Usage usage) : VBO(vertex_layout(), mode, usage) {}
+
+VBO::VBO(const std::vector<VertexAttribute> & layout, VBO::Mode mode, VBO::Usage usage)
+    : vbo(0), vao(0), mode(mode), usage(usage), nPoints(0), nAttributes(0) {
 
     glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glGenVertexArrays(1, &vao);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)(6 * sizeof(float)));
+    setLayout(layout);
 }
 
 VBO::~VBO() {
-    glDeleteBuffers(1, &vbo);
+    GLState::deleteVertexArray(vao);
+    GLState::deleteBuffer(vbo);
 }
 
 GLuint VBO::getVBO() const {
@@ -107,15 +126,53 @@ void VBO::setUsage(VBO::Usage usage) {
     this->usage = usage;
 }
 
+void VBO::setLayout(const std::vector<VertexAttribute> & layout) {
+    // The attribute layout belongs to the vao, not whatever vao is bound
+    GLState::bindVertexArray(vao);
+    GLState::bindArrayBuffer(vbo);
+
+    for (GLuint i = 0; i < layout.size(); i++) {
+        auto & attribute = layout[i];
+        auto offset = reinterpret_cast<const void *>(attribute.offset);
+        glEnableVertexAttribArray(i);
+        if (attribute.integer)
+            glVertexAttribIPointer(i, attribute.size, attribute.type, attribute.stride, offset);
+        else
+            glVertexAttribPointer(i, attribute.size, attribute.type, GL_FALSE, attribute.stride,
+                                  offset);
+    }
+    for (GLuint i = layout.size(); i < nAttributes; i++) {
+        glDisableVertexAttribArray(i);
+    }
+    nAttributes = layout.size();
+
+    GLState::bindVertexArray(0);
+}
+
 void VBO::loadFromPoints(const std::vector<Vertex> & points) {
-    nPoints = points.size();
+    loadFromPoints(points.data(), points.size());
+}
+
+void VBO::loadFromPoints(const Vertex * points, size_t n) {
+    loadFromData(points, sizeof(Vertex) * n, n);
+}
+
+void VBO::loadFromData(const void * data, size_t bytes, size_t n) {
+    nPoints = n;
+
+    GLState::bindArrayBuffer(vbo);
+
+    glBufferData(GL_ARRAY_BUFFER, bytes, data, usage);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+void VBO::loadSubData(size_t offset, const void * data, size_t bytes) {
+    GLState::bindArrayBuffer(vbo);
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * nPoints, points.data(), usage);
+    glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
 }
 
 void VBO::draw() const {
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    TRACE_GL_SCOPE("draw");
+    GLState::bindVertexArray(vao);
     glDrawArrays(mode, 0, nPoints);
 }
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
 
 #include <glm/glm.hpp>
 #include <memory>
@@ -94,7 +94,40 @@ void draw_array(const std::vector<Vertex> & vertices, GLenum mode);
 void draw_quad(const glm::vec2 & pos, const glm::vec2 & size);
 
 /**
- * Manages a single vertex buffered object and vertex array object.
+ * Get two triangles covering clip space, for drawing a fragment shader over
+ * the whole viewport.
+ *
+ * @return the 6 vertices
+ */
+std::vector<Vertex> fullscreen_quad();
+
+/**
+ * The layout of one attribute in the buffer of a VBO, the attribute index is
+ * its position in the layout.
+ */
+struct VertexAttribute {
+    /// The number of components, 1 to 4
+    GLint size;
+    /// The component type, eg. GL_FLOAT or GL_INT
+    GLenum type;
+    /// Bytes from one value to the next, 0 if tightly packed
+    GLsizei stride;
+    /// The offset in bytes of the first value
+    size_t offset;
+    /// Pass integer types to the shader as integers instead of floats
+    bool integer = false;
+};
+
+/**
+ * Get the layout of Vertex: pos, norm and uv at indices 0, 1 and 2.
+ *
+ * @return the 3 attributes
+ */
+std::vector<VertexAttribute> vertex_layout();
+
+/**
+ * Manages a single vertex buffered object and vertex array object. The points
+ * are Vertex objects unless the VBO is created with another layout.
  */
 class VBO {
 public:
@@ -102,6 +135,8 @@ public:
      * OpenGL Draw mode.
      */
     enum Mode {
+        Points = GL_POINTS,
+
         Lines = GL_LINES,
         LineStrip = GL_LINE_STRIP,
         LineLoop = GL_LINE_LOOP,
@@ -125,22 +160,35 @@ public:
 
 private:
     GLuint vbo;
+    GLuint vao;
     Mode mode;
     Usage usage;
     size_t nPoints;
+    size_t nAttributes;
 
 public:
     using Ptr = std::shared_ptr<VBO>;
     using ConstPtr = std::shared_ptr<const VBO>;
 
     /**
-     * Create a new VBO with mode and usage.
+     * Create a new VBO of Vertex points with mode and usage.
      *
      * @param mode the OpenGL draw mode
      * @param usage the OpenGL buffer usage
      */
     VBO(Mode mode = Mode::Triangles, Usage usage = Usage::Static);
 
+    /**
+     * Create a new VBO with the attribute layout of its points.
+     *
+     * @param layout the attributes, see setLayout
+     * @param mode the OpenGL draw mode
+     * @param usage the OpenGL buffer usage
+     */
+    VBO(const std::vector<VertexAttribute> & layout,
+        Mode mode = Mode::Points,
+        Usage usage = Usage::Static);
+
     /**
      * Free OpenGL buffers.
      */
@@ -188,6 +236,14 @@ public:
      */
     void setUsage(Usage usage);
 
+    /**
+     * Set the attribute layout of the buffer in the vao, attributes past
+     * the new layout are disabled.
+     *
+     * @param layout the attributes, attribute i is read at location i
+     */
+    void setLayout(const std::vector<VertexAttribute> & layout);
+
     /**
      * Load buffer with data from points.
      *
@@ -204,7 +260,26 @@ public:
     void loadFromPoints(const Vertex * points, size_t n);
 
     /**
-     * Bind the vao, then draw, then unbind the vao.
+     * Load buffer with bytes of data in the layout of this VBO.
+     *
+     * @param data the data to send to the buffer, nullptr to only allocate
+     * @param bytes the size of the buffer in bytes
+     * @param n the number of points
+     */
+    void loadFromData(const void * data, size_t bytes, size_t n);
+
+    /**
+     * Replace part of the buffer loaded by loadFromData, the number of
+     * points is kept.
+     *
+     * @param offset the offset in bytes
+     * @param data the data to send to the buffer
+     * @param bytes the number of bytes
+     */
+    void loadSubData(size_t offset, const void * data, size_t bytes);
+
+    /**
+     * Bind the vao, which holds the attribute layout, then draw.
      */
     void draw() const;
 };
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(size_t count, Factory factory)
+    : queued(0), pending(0), next(0), stopping(false) {
+    if (count == 0)
+        count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t i = 0; i < count; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    // Start only once every queue exists, workers steal from all of them
+    for (size_t i = 0; i < count; i++) {
+        workers[i]->thread = std::thread(&WorkerPool::run, this, i, factory);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto & worker : workers) {
+        worker->thread.join();
+    }
+}
+
+size_t WorkerPool::size() const {
+    return workers.size();
+}
+
+void WorkerPool::submit(Task task) {
+    // Counted before it is queued so a worker can never take a task that is
+    // not counted yet
+    size_t index;
+    {
+        std::lock_guard lock(mutex);
+        index = next++ % workers.size();
+        queued++;
+        pending++;
+    }
+
+    {
+        std::lock_guard lock(workers[index]->mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+void WorkerPool::wait() {
+    std::unique_lock lock(mutex);
+    idle.wait(lock, [&] { return pending == 0; });
+}
+
+bool WorkerPool::take(size_t index, Task & task) {
+    // Own queue first, then steal starting from the next worker
+    for (size_t i = 0; i < workers.size(); i++) {
+        auto & worker = *workers[(index + i) % workers.size()];
+        std::lock_guard lock(worker.mutex);
+        if (worker.tasks.empty())
+            continue;
+
+        if (i == 0) {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        else {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+void WorkerPool::run(size_t index, const Factory & factory) {
+    auto backend = factory();
+
+    while (true) {
+        Task task;
+        if (take(index, task)) {
+            {
+                std::lock_guard lock(mutex);
+                queued--;
+            }
+
+            task(*backend);
+
+            std::lock_guard lock(mutex);
+            if (--pending == 0) {
+                idle.notify_all();
+                // Workers waiting to stop sleep until the last task is done
+                wake.notify_all();
+            }
+            continue;
+        }
+
+        // A counted task may still be on its way into a queue, then this
+        // wakes at once and tries again
+        std::unique_lock lock(mutex);
+        if (stopping && pending == 0)
+            return;
+        wake.wait(lock, [&] { return queued > 0 || (stopping && pending == 0); });
+        if (stopping && pending == 0)
+            return;
+    }
+}
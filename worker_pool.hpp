@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "backend.hpp"
+
+/**
+ * A pool of threads that each own a Backend, created on the thread itself so
+ * a GLBackend context is current on the thread that uses it.
+ *
+ * Tasks are spread round robin over per worker queues. A worker takes from
+ * the front of its own queue and when that is empty steals from the back of
+ * another, so uneven tasks still keep every worker busy.
+ */
+class WorkerPool {
+public:
+    /// Creates the backend of a worker, called on the worker thread
+    using Factory = std::function<Backend::Ptr()>;
+    /// A unit of work run with the backend of the worker that takes it
+    using Task = std::function<void(Backend &)>;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    size_t queued;
+    size_t pending;
+    size_t next;
+    bool stopping;
+
+    bool take(size_t index, Task & task);
+
+    void run(size_t index, const Factory & factory);
+
+public:
+    /**
+     * Start the workers.
+     *
+     * @param count the number of workers, 0 for one per core
+     * @param factory creates the backend of each worker
+     */
+    WorkerPool(size_t count, Factory factory);
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool & operator=(const WorkerPool &) = delete;
+
+    /**
+     * Finish every submitted task, then stop and join the workers.
+     */
+    ~WorkerPool();
+
+    /**
+     * Get the number of workers.
+     */
+    size_t size() const;
+
+    /**
+     * Queue task to run on some worker.
+     *
+     * @param task the task
+     */
+    void submit(Task task);
+
+    /**
+     * Block until every submitted task has finished.
+     */
+    void wait();
+};